@@ -0,0 +1,117 @@
+#include "alt.hpp"
+#include "snapshot.hpp"
+
+using namespace std;
+
+void Landmarks::build(const Graph& graph, uint32_t count) {
+    size_t n = graph.vertexCount();
+    vector<Index> chosen;
+    vector<vector<float>> from_columns, to_columns;
+    vector<double> forward, backward;
+    // 每个顶点到已选地标的最小往返距离，下一个地标取其中最大者；
+    // 只在最大连通分量里选，其他分量（孤立的小块路网）的顶点和已选的地标都为 0，不作为候选
+    vector<double> separation(n, 0);
+    for (Index v = 0; v < n; ++v) {
+        if (graph.componentOf(v) == 0) separation[v] = numeric_limits<double>::max();
+    }
+    double max_value = 0;
+
+    // 第一个地标：最大连通分量中离该分量任一顶点最远的可达顶点
+    Index next = Graph::kInvalidIndex;
+    Index origin = Index(find_if(separation.begin(), separation.end(), [](double s) { return s > 0; }) - separation.begin());
+    if (origin < n) {
+        graph.distancesFrom(origin, false, forward);
+        next = origin;
+        for (Index v = 0; v < n; ++v) {
+            if (separation[v] > 0 && forward[v] != SearchSpace::kInfinity && forward[v] > forward[next]) next = v;
+        }
+    }
+
+    while (next != Graph::kInvalidIndex && chosen.size() < count) {
+        chosen.push_back(next);
+        graph.distancesFrom(next, false, forward);
+        graph.distancesFrom(next, true, backward);
+        vector<float>& from = from_columns.emplace_back(n);
+        vector<float>& to = to_columns.emplace_back(n);
+        for (Index v = 0; v < n; ++v) {
+            bool reachable = forward[v] != SearchSpace::kInfinity && backward[v] != SearchSpace::kInfinity;
+            from[v] = forward[v] == SearchSpace::kInfinity ? numeric_limits<float>::infinity() : float(forward[v]);
+            to[v] = backward[v] == SearchSpace::kInfinity ? numeric_limits<float>::infinity() : float(backward[v]);
+            if (reachable) {
+                max_value = max(max_value, max(forward[v], backward[v]));
+                separation[v] = min(separation[v], forward[v] + backward[v]);
+            } else {
+                separation[v] = 0; // 不与地标强连通的顶点不作为候选
+            }
+        }
+        separation[next] = 0;
+        auto farthest = max_element(separation.begin(), separation.end());
+        next = *farthest > 0 ? Index(farthest - separation.begin()) : Graph::kInvalidIndex;
+    }
+
+    // 按顶点交错存放：[v * count + i]
+    count = uint32_t(chosen.size());
+    vector<float> from(n * count), to(n * count);
+    for (uint32_t i = 0; i < count; ++i) {
+        for (Index v = 0; v < n; ++v) {
+            from[size_t(v) * count + i] = from_columns[i][v];
+            to[size_t(v) * count + i] = to_columns[i][v];
+        }
+    }
+
+    count_ = count;
+    landmarks_.assign(std::move(chosen));
+    from_.assign(std::move(from));
+    to_.assign(std::move(to));
+    // 两个 float 相减的绝对误差不超过 2 * max_value * 2^-24
+    slack_ = max_value * 0x1p-22;
+}
+
+double Landmarks::lowerBound(Index v, Index t) const {
+    const float* from_v = from_.data() + size_t(v) * count_;
+    const float* from_t = from_.data() + size_t(t) * count_;
+    const float* to_v = to_.data() + size_t(v) * count_;
+    const float* to_t = to_.data() + size_t(t) * count_;
+    double best = 0;
+    for (uint32_t i = 0; i < count_; ++i) {
+        // 无穷大参与的差值没有意义，跳过该项仍然是下界
+        if (from_v[i] != numeric_limits<float>::infinity()) best = max(best, double(from_t[i]) - from_v[i]);
+        if (to_t[i] != numeric_limits<float>::infinity()) best = max(best, double(to_v[i]) - to_t[i]);
+    }
+    if (best == numeric_limits<double>::infinity()) return best;
+    return max(0.0, best - slack_);
+}
+
+std::vector<long long> Landmarks::query(const Graph& graph, const Endpoint& source, const Endpoint& target) const {
+    return graph.a_star(source, target, [this, &target](Index v) {
+        double h = numeric_limits<double>::infinity();
+        for (uint32_t i = 0; i < target.count; ++i) {
+            h = min(h, lowerBound(v, target.anchors[i].vertex) + target.anchors[i].offset);
+        }
+        return h;
+    });
+}
+
+void Landmarks::save(SnapshotWriter& writer) const {
+    writer.add(sectionTag("LMID"), landmarks_.data(), landmarks_.size());
+    writer.add(sectionTag("LMFR"), from_.data(), from_.size());
+    writer.add(sectionTag("LMTO"), to_.data(), to_.size());
+    writer.add(sectionTag("LMSL"), &slack_, 1);
+}
+
+bool Landmarks::load(const SnapshotReader& reader) {
+    size_t landmark_count, from_count, to_count, slack_count;
+    const Index* ids = reader.get<Index>(sectionTag("LMID"), landmark_count);
+    const float* from = reader.get<float>(sectionTag("LMFR"), from_count);
+    const float* to = reader.get<float>(sectionTag("LMTO"), to_count);
+    const double* slack = reader.get<double>(sectionTag("LMSL"), slack_count);
+    if (!ids || !from || !to || !slack || slack_count != 1) return false;
+    if (from_count != to_count || (landmark_count && from_count % landmark_count != 0)) return false;
+
+    count_ = uint32_t(landmark_count);
+    landmarks_.attach(ids, landmark_count);
+    from_.attach(from, from_count);
+    to_.attach(to, to_count);
+    slack_ = *slack;
+    return true;
+}
@@ -0,0 +1,334 @@
+#include "ch.hpp"
+#include "snapshot.hpp"
+
+using namespace std;
+
+namespace {
+
+using Index = Graph::Index;
+const Index kNone = Graph::kInvalidIndex;
+
+// 见证搜索最多结算的顶点数；超过后保守地添加捷径
+const int kWitnessSettleLimit = 500;
+
+struct DynamicArc {
+    Index other;
+    Index middle;
+    double weight;
+    double length;
+};
+
+// 收缩过程中的动态图，只保留未收缩顶点之间的边
+class ContractionGraph {
+public:
+    explicit ContractionGraph(const Graph& graph)
+        : out_(graph.vertexCount()), in_(graph.vertexCount()),
+          contracted_(graph.vertexCount(), false), contracted_neighbors_(graph.vertexCount(), 0) {
+        for (Index v = 0; v < graph.vertexCount(); ++v) {
+            for (uint32_t e = graph.edgeBegin(v); e < graph.edgeEnd(v); ++e) {
+                Index w = graph.edgeTarget(e);
+                // 驾车不能通行的边边权为无穷大，不参与收缩
+                if (w != v && graph.edgeWeight(e) != SearchSpace::kInfinity) {
+                    addArc(v, w, graph.edgeWeight(e), graph.edgeLength(e), kNone);
+                }
+            }
+        }
+    }
+
+    size_t size() const { return out_.size(); }
+    const vector<DynamicArc>& out(Index v) const { return out_[v]; }
+    const vector<DynamicArc>& in(Index v) const { return in_[v]; }
+
+    // 平行边只保留权重最小的一条
+    void addArc(Index from, Index to, double weight, double length, Index middle) {
+        improve(out_[from], {to, middle, weight, length});
+        improve(in_[to], {from, middle, weight, length});
+    }
+
+    // 收缩 v 需要添加的捷径；apply 为 false 时只计数（用于计算优先级）
+    int contract(Index v, bool apply) {
+        int shortcuts = 0;
+        pending_.clear();
+        for (const auto& in_arc : in_[v]) {
+            Index u = in_arc.other;
+            // 边权可以为 0（重合的路口、长度为 0 的路段），是否需要见证搜索看有没有 u 以外的出边终点
+            double max_cost = 0;
+            bool has_target = false;
+            for (const auto& out_arc : out_[v]) {
+                if (out_arc.other == u) continue;
+                has_target = true;
+                max_cost = max(max_cost, in_arc.weight + out_arc.weight);
+            }
+            if (!has_target) continue;
+            witnessSearch(u, v, max_cost);
+            const SearchSpace& space = Graph::workspace(0);
+            for (const auto& out_arc : out_[v]) {
+                Index w = out_arc.other;
+                if (w == u) continue;
+                double via = in_arc.weight + out_arc.weight;
+                if (space.distance(w) > via) {
+                    ++shortcuts;
+                    if (apply) pending_.push_back({u, w, via, in_arc.length + out_arc.length});
+                }
+            }
+        }
+        if (!apply) return shortcuts;
+
+        for (const auto& s : pending_) addArc(s.from, s.to, s.weight, s.length, v);
+        contracted_[v] = true;
+        for (const auto& arc : out_[v]) {
+            erase(in_[arc.other], v);
+            ++contracted_neighbors_[arc.other];
+        }
+        for (const auto& arc : in_[v]) {
+            erase(out_[arc.other], v);
+            ++contracted_neighbors_[arc.other];
+        }
+        return shortcuts;
+    }
+
+    // 优先级：边差（新增捷径数 - 删除的边数）加上已收缩的邻居数，越小越先收缩
+    int priority(Index v) {
+        int shortcuts = contract(v, false);
+        return shortcuts - int(in_[v].size() + out_[v].size()) + contracted_neighbors_[v];
+    }
+
+    void release(Index v) {
+        out_[v] = vector<DynamicArc>();
+        in_[v] = vector<DynamicArc>();
+    }
+
+private:
+    struct Shortcut {
+        Index from, to;
+        double weight;
+        double length;
+    };
+    vector<vector<DynamicArc>> out_, in_;
+    vector<bool> contracted_;
+    vector<int> contracted_neighbors_;
+    vector<Shortcut> pending_;
+
+    static void improve(vector<DynamicArc>& arcs, const DynamicArc& candidate) {
+        for (auto& arc : arcs) {
+            if (arc.other == candidate.other) {
+                if (candidate.weight < arc.weight) arc = candidate;
+                return;
+            }
+        }
+        arcs.push_back(candidate);
+    }
+
+    static void erase(vector<DynamicArc>& arcs, Index other) {
+        for (size_t i = 0; i < arcs.size(); ++i) {
+            if (arcs[i].other == other) {
+                arcs[i] = arcs.back();
+                arcs.pop_back();
+                return;
+            }
+        }
+    }
+
+    // 从 source 出发、绕开 avoid 的有限 Dijkstra，结果留在 workspace(0) 中
+    void witnessSearch(Index source, Index avoid, double max_cost) {
+        SearchSpace& space = Graph::workspace(0);
+        space.reset(size());
+        space.update(source, 0, 0, kNone);
+        space.push(0, source);
+        int settled = 0;
+        while (!space.empty()) {
+            auto [dist, v] = space.pop();
+            if (dist > space.distance(v)) continue;
+            if (dist > max_cost || ++settled > kWitnessSettleLimit) break;
+            for (const auto& arc : out_[v]) {
+                if (arc.other == avoid) continue;
+                double d = dist + arc.weight;
+                if (d < space.distance(arc.other)) {
+                    space.update(arc.other, d, d, v);
+                    space.push(d, arc.other);
+                }
+            }
+        }
+    }
+};
+
+} // namespace
+
+void ContractionHierarchy::build(const Graph& graph) {
+    size_t n = graph.vertexCount();
+    ContractionGraph dynamic(graph);
+
+    priority_queue<pair<int, Index>, vector<pair<int, Index>>, greater<>> queue;
+    for (Index v = 0; v < n; ++v) queue.push({dynamic.priority(v), v});
+
+    vector<Index> rank(n, kNone);
+    vector<vector<Arc>> up(n), down(n);
+    Index next_rank = 0;
+    while (!queue.empty()) {
+        Index v = queue.top().second;
+        queue.pop();
+        if (rank[v] != kNone) continue;
+        // 惰性更新：优先级变大且不再是最小时放回队列
+        int current = dynamic.priority(v);
+        if (!queue.empty() && current > queue.top().first) {
+            queue.push({current, v});
+            continue;
+        }
+
+        // 此时与 v 相连的都是 rank 更高的顶点，这些边就是 v 的上行边
+        for (const auto& arc : dynamic.out(v)) up[v].push_back({arc.other, arc.middle, arc.weight, arc.length});
+        for (const auto& arc : dynamic.in(v)) down[v].push_back({arc.other, arc.middle, arc.weight, arc.length});
+        dynamic.contract(v, true);
+        dynamic.release(v);
+        rank[v] = next_rank++;
+    }
+
+    auto flatten = [n](vector<vector<Arc>>& lists, Column<uint32_t>& offsets_column, Column<Arc>& arcs_column) {
+        vector<uint32_t> offsets(n + 1, 0);
+        vector<Arc> arcs;
+        for (Index v = 0; v < n; ++v) {
+            arcs.insert(arcs.end(), lists[v].begin(), lists[v].end());
+            offsets[v + 1] = uint32_t(arcs.size());
+            lists[v] = vector<Arc>();
+        }
+        offsets_column.assign(std::move(offsets));
+        arcs_column.assign(std::move(arcs));
+    };
+    flatten(up, up_offsets_, up_arcs_);
+    flatten(down, down_offsets_, down_arcs_);
+    rank_.assign(std::move(rank));
+}
+
+std::vector<long long> ContractionHierarchy::query(const Graph& graph, const Endpoint& source,
+                                                   const Endpoint& target) const {
+    if (source.count == 0 || target.count == 0 || empty()) return {};
+
+    SearchSpace& forward = Graph::workspace(0);
+    SearchSpace& backward = Graph::workspace(1);
+    forward.reset(graph.vertexCount());
+    backward.reset(graph.vertexCount());
+    auto seed = [](SearchSpace& space, const Endpoint& endpoint) {
+        for (uint32_t i = 0; i < endpoint.count; ++i) {
+            const Endpoint::Anchor& anchor = endpoint.anchors[i];
+            if (anchor.offset >= space.distance(anchor.vertex)) continue;
+            space.update(anchor.vertex, anchor.offset, anchor.offset, kNone);
+            space.push(anchor.offset, anchor.vertex);
+        }
+    };
+    seed(forward, source);
+    seed(backward, target);
+
+    // 相遇点在出堆时检查，两端共享的锚点也会在那时被发现
+    double mu = numeric_limits<double>::max();
+    Index meet_point = kNone;
+    bool forward_done = false, backward_done = false;
+    bool expand_forward = true;
+    while (!forward_done || !backward_done) {
+        if (forward.empty() || forward.top().first >= mu) forward_done = true;
+        if (backward.empty() || backward.top().first >= mu) backward_done = true;
+        // 两侧交替扩展；一侧结束后只扩展另一侧
+        if (forward_done && backward_done) break;
+        if (forward_done) expand_forward = false;
+        else if (backward_done) expand_forward = true;
+
+        SearchSpace& space = expand_forward ? forward : backward;
+        const SearchSpace& other = expand_forward ? backward : forward;
+        const Column<uint32_t>& offsets = expand_forward ? up_offsets_ : down_offsets_;
+        const Column<Arc>& arcs = expand_forward ? up_arcs_ : down_arcs_;
+        const Column<uint32_t>& opposite_offsets = expand_forward ? down_offsets_ : up_offsets_;
+        const Column<Arc>& opposite_arcs = expand_forward ? down_arcs_ : up_arcs_;
+        expand_forward = !expand_forward;
+
+        auto [dist, v] = space.pop();
+        if (dist > space.distance(v)) continue;
+        if (other.reached(v) && dist + other.distance(v) < mu) {
+            mu = dist + other.distance(v);
+            meet_point = v;
+        }
+
+        // stall-on-demand：若能从更高 rank 的已到达顶点更便宜地到达 v，则 v 不会在最短路上，不必扩展
+        bool stalled = false;
+        for (uint32_t i = opposite_offsets[v]; i < opposite_offsets[v + 1] && !stalled; ++i) {
+            const Arc& arc = opposite_arcs[i];
+            stalled = space.distance(arc.other) + arc.weight < dist;
+        }
+        if (stalled) continue;
+
+        for (uint32_t i = offsets[v]; i < offsets[v + 1]; ++i) {
+            const Arc& arc = arcs[i];
+            double d = dist + arc.weight;
+            if (d < space.distance(arc.other)) {
+                space.update(arc.other, d, d, v);
+                space.push(d, arc.other);
+            }
+        }
+    }
+
+    if (meet_point == kNone) return {};
+
+    // 搜索树上的顶点序列：起点 ... 交汇点 ... 终点
+    vector<Index> hops;
+    for (Index at = meet_point; at != kNone; at = forward.parent(at)) hops.push_back(at);
+    reverse(hops.begin(), hops.end());
+    for (Index at = backward.parent(meet_point); at != kNone; at = backward.parent(at)) hops.push_back(at);
+
+    vector<VertexId> path{graph.idOf(hops.front())};
+    for (size_t i = 0; i + 1 < hops.size(); ++i) unpackArc(graph, hops[i], hops[i + 1], path);
+    return path;
+}
+
+const ContractionHierarchy::Arc* ContractionHierarchy::findArc(Index a, Index b) const {
+    // rank 低的一端保存这条边：a 低时在 a 的正向上行边里，否则在 b 的反向上行边里
+    bool upward = rank_[a] < rank_[b];
+    Index owner = upward ? a : b;
+    Index other = upward ? b : a;
+    const Column<uint32_t>& offsets = upward ? up_offsets_ : down_offsets_;
+    const Column<Arc>& arcs = upward ? up_arcs_ : down_arcs_;
+    for (uint32_t i = offsets[owner]; i < offsets[owner + 1]; ++i) {
+        if (arcs[i].other == other) return &arcs[i];
+    }
+    return nullptr;
+}
+
+void ContractionHierarchy::unpackArc(const Graph& graph, Index a, Index b, vector<VertexId>& path) const {
+    // 用显式栈展开捷径，按原方向依次输出除 a 以外的节点
+    vector<pair<Index, Index>> stack{{a, b}};
+    while (!stack.empty()) {
+        auto [from, to] = stack.back();
+        stack.pop_back();
+        const Arc* arc = findArc(from, to);
+        if (!arc || arc->middle == kNone) {
+            path.push_back(graph.idOf(to));
+            continue;
+        }
+        stack.push_back({arc->middle, to});
+        stack.push_back({from, arc->middle});
+    }
+}
+
+void ContractionHierarchy::save(SnapshotWriter& writer) const {
+    writer.add(sectionTag("CHRK"), rank_.data(), rank_.size());
+    writer.add(sectionTag("CHUO"), up_offsets_.data(), up_offsets_.size());
+    writer.add(sectionTag("CHUA"), up_arcs_.data(), up_arcs_.size());
+    writer.add(sectionTag("CHDO"), down_offsets_.data(), down_offsets_.size());
+    writer.add(sectionTag("CHDA"), down_arcs_.data(), down_arcs_.size());
+}
+
+bool ContractionHierarchy::load(const SnapshotReader& reader) {
+    size_t rank_count, up_offset_count, up_arc_count, down_offset_count, down_arc_count;
+    const Index* rank = reader.get<Index>(sectionTag("CHRK"), rank_count);
+    const uint32_t* up_offsets = reader.get<uint32_t>(sectionTag("CHUO"), up_offset_count);
+    const Arc* up_arcs = reader.get<Arc>(sectionTag("CHUA"), up_arc_count);
+    const uint32_t* down_offsets = reader.get<uint32_t>(sectionTag("CHDO"), down_offset_count);
+    const Arc* down_arcs = reader.get<Arc>(sectionTag("CHDA"), down_arc_count);
+    if (!rank || !up_offsets || !up_arcs || !down_offsets || !down_arcs) return false;
+    if (up_offset_count != rank_count + 1 || down_offset_count != rank_count + 1) return false;
+    if (up_offsets[rank_count] != up_arc_count || down_offsets[rank_count] != down_arc_count) return false;
+
+    rank_.attach(rank, rank_count);
+    up_offsets_.attach(up_offsets, up_offset_count);
+    up_arcs_.attach(up_arcs, up_arc_count);
+    down_offsets_.attach(down_offsets, down_offset_count);
+    down_arcs_.attach(down_arcs, down_arc_count);
+    return true;
+}
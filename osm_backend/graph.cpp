@@ -1,5 +1,6 @@
 
 #include "graph.hpp"
+#include "snapshot.hpp"
 
 using namespace std;
 
@@ -21,31 +22,6 @@ double calculateDistance(const Node& from, const Node& to) {
     return R * c; // 返回距离，单位：米
 }
 
-double calculateManhattanDistance(const Node& from, const Node& to) {
-    // 地球半径，单位：米
-    double R = 6371e3;
-
-    // 将经纬度从度数转换为弧度
-    double lat1 = from.lat * M_PI / 180;
-    double lon1 = from.lon * M_PI / 180;
-    double lat2 = to.lat * M_PI / 180;
-    double lon2 = to.lon * M_PI / 180;
-
-    // 计算纬度和经度的差异（以弧度为单位）
-    double delta_lat = fabs(lat2 - lat1);
-    double delta_lon = fabs(lon2 - lon1);
-
-    // 使用平均纬度来估算每个经度度数对应的地面距离
-    double avg_lat = (lat1 + lat2) / 2;
-
-    // 计算南北方向和东西方向的距离
-    double north_south_distance = delta_lat * R;
-    double east_west_distance = delta_lon * R * 0.8544588301328;
-
-    // 曼哈顿距离为两个方向距离之和
-    return min(north_south_distance, east_west_distance); // 返回距离，单位：米
-}
-
 double calculateDistanceWithLatAndLon(double lat1, double lon1, double lat2, double lon2) {
     // 使用Haversine公式计算地球表面上两点之间的距离
     // 这里仅提供了一个简化的例子，实际应用中应该更精确地实现
@@ -63,228 +39,840 @@ double calculateDistanceWithLatAndLon(double lat1, double lon1, double lat2, dou
     return R * c; // 返回距离，单位：米
 }
 
-
-long long findNearestNode(double targetLat, double targetLon) {
-    
-    return kdtree.findNearestNode(targetLat, targetLon);
+void Graph::addChain(VertexId from, VertexId to, double weight, double length, uint32_t way, uint8_t road_class,
+                     const vector<ShapePoint>& shape, uint8_t forward_modes, uint8_t backward_modes) {
+    uint32_t chain = uint32_t(pending_chain_offsets_.size() - 1);
+    pending_chain_points_.insert(pending_chain_points_.end(), shape.begin(), shape.end());
+    pending_chain_offsets_.push_back(uint32_t(pending_chain_points_.size()));
+    auto weightFor = [weight](uint8_t modes) { return modes & kCar ? weight : SearchSpace::kInfinity; };
+    if (forward_modes) {
+        pending_.push_back({from, to, weightFor(forward_modes), length, way, chain << 1, road_class, forward_modes});
+    }
+    if (backward_modes) {
+        pending_.push_back({to, from, weightFor(backward_modes), length, way, chain << 1 | 1, road_class, backward_modes});
+    }
 }
 
-void Graph::addEdge(VertexId from, VertexId to, double weight) {
-        adjacency_list[from].emplace_back(to, weight);
-        adjacency_list[to].emplace_back(from, weight); // 如果是无向图
+void Graph::freeze(const vector<Node>& coordinates) {
+    // 收集所有端点并排序去重，得到下标 -> OSM ID 的映射
+    vector<VertexId> ids;
+    ids.reserve(pending_.size() * 2);
+    for (const auto& e : pending_) {
+        ids.push_back(e.from);
+        ids.push_back(e.to);
+    }
+    sort(ids.begin(), ids.end());
+    ids.erase(unique(ids.begin(), ids.end()), ids.end());
+    ids_.assign(std::move(ids));
+
+    // 两边都按 ID 升序，一次归并取出顶点坐标
+    vector<double> lats(ids_.size()), lons(ids_.size());
+    size_t next = 0;
+    for (size_t v = 0; v < ids_.size(); ++v) {
+        while (next < coordinates.size() && coordinates[next].id < ids_[v]) ++next;
+        if (next < coordinates.size() && coordinates[next].id == ids_[v]) {
+            lats[v] = coordinates[next].lat;
+            lons[v] = coordinates[next].lon;
+        }
+    }
+    lats_.assign(std::move(lats));
+    lons_.assign(std::move(lons));
+
+    // 计数排序：先统计出度得到 offsets，再按起点把边放进对应区间
+    size_t n = ids_.size();
+    vector<uint32_t> offsets(n + 1, 0);
+    vector<Index> from_index(pending_.size());
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        from_index[i] = indexOf(pending_[i].from);
+        ++offsets[from_index[i] + 1];
+    }
+    for (size_t v = 0; v < n; ++v) offsets[v + 1] += offsets[v];
+
+    vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    vector<Index> targets(pending_.size());
+    vector<double> weights(pending_.size());
+    vector<float> lengths(pending_.size());
+    vector<uint32_t> edge_ways(pending_.size());
+    vector<uint32_t> edge_chains(pending_.size());
+    vector<uint8_t> edge_classes(pending_.size());
+    vector<uint8_t> edge_modes(pending_.size());
+    for (size_t i = 0; i < pending_.size(); ++i) {
+        uint32_t slot = cursor[from_index[i]]++;
+        targets[slot] = indexOf(pending_[i].to);
+        weights[slot] = pending_[i].weight;
+        lengths[slot] = float(pending_[i].length);
+        edge_ways[slot] = pending_[i].way;
+        edge_chains[slot] = pending_[i].chain;
+        edge_classes[slot] = pending_[i].road_class;
+        edge_modes[slot] = pending_[i].modes;
+    }
+    offsets_.assign(std::move(offsets));
+    targets_.assign(std::move(targets));
+    weights_.assign(std::move(weights));
+    lengths_.assign(std::move(lengths));
+    edge_ways_.assign(std::move(edge_ways));
+    edge_chains_.assign(std::move(edge_chains));
+    edge_classes_.assign(std::move(edge_classes));
+    edge_modes_.assign(std::move(edge_modes));
+    chain_offsets_.assign(std::move(pending_chain_offsets_));
+    chain_points_.assign(std::move(pending_chain_points_));
+    pending_ = vector<PendingEdge>();
+    pending_chain_offsets_ = vector<uint32_t>{0};
+    pending_chain_points_ = vector<ShapePoint>();
+
+    // 由正向 CSR 转置得到反向 CSR
+    vector<uint32_t> rev_offsets(n + 1, 0);
+    for (Index t : targets_) ++rev_offsets[t + 1];
+    for (size_t v = 0; v < n; ++v) rev_offsets[v + 1] += rev_offsets[v];
+    vector<uint32_t> rev_cursor(rev_offsets.begin(), rev_offsets.end() - 1);
+    vector<Index> rev_sources(targets_.size());
+    vector<double> rev_weights(targets_.size());
+    vector<uint32_t> rev_edges(targets_.size());
+    for (Index v = 0; v < n; ++v) {
+        for (uint32_t e = offsets_[v]; e < offsets_[v + 1]; ++e) {
+            uint32_t slot = rev_cursor[targets_[e]]++;
+            rev_sources[slot] = v;
+            rev_weights[slot] = weights_[e];
+            rev_edges[slot] = e;
+        }
+    }
+    rev_offsets_.assign(std::move(rev_offsets));
+    rev_sources_.assign(std::move(rev_sources));
+    rev_weights_.assign(std::move(rev_weights));
+    rev_edges_.assign(std::move(rev_edges));
+
+    // 取所有边上 边权/球面距离 的最小值，保证下界不超过任何一条边的真实代价
+    heuristic_scale_ = numeric_limits<double>::max();
+    for (Index v = 0; v < n; ++v) {
+        for (uint32_t e = offsets_[v]; e < offsets_[v + 1]; ++e) {
+            Index t = targets_[e];
+            double meters = calculateDistanceWithLatAndLon(lats_[v], lons_[v], lats_[t], lons_[t]);
+            if (meters > 0) heuristic_scale_ = min(heuristic_scale_, weights_[e] / meters);
+        }
+    }
+    if (heuristic_scale_ == numeric_limits<double>::max()) heuristic_scale_ = 0;
+
+    // 并查集求弱连通分量，再按分量大小降序重新编号
+    vector<Index> parent(n);
+    for (Index v = 0; v < n; ++v) parent[v] = v;
+    auto find = [&parent](Index v) {
+        while (parent[v] != v) v = parent[v] = parent[parent[v]];
+        return v;
+    };
+    for (Index v = 0; v < n; ++v) {
+        for (uint32_t e = offsets_[v]; e < offsets_[v + 1]; ++e) {
+            Index a = find(v), b = find(targets_[e]);
+            if (a != b) parent[max(a, b)] = min(a, b);
+        }
+    }
+    vector<uint32_t> size(n, 0);
+    for (Index v = 0; v < n; ++v) ++size[find(v)];
+    vector<Index> roots;
+    for (Index v = 0; v < n; ++v) {
+        if (size[v] > 0) roots.push_back(v);
+    }
+    stable_sort(roots.begin(), roots.end(), [&size](Index a, Index b) { return size[a] > size[b]; });
+    vector<uint32_t> label(n);
+    for (uint32_t i = 0; i < roots.size(); ++i) label[roots[i]] = i;
+    vector<uint32_t> components(n);
+    for (Index v = 0; v < n; ++v) components[v] = label[find(v)];
+    components_.assign(std::move(components));
+    restrictTurns({});
 }
 
-    // Dijkstra算法用于查找最短路径
-vector<long long> Graph::dijkstra(VertexId start, VertexId end) {
-    unordered_map<VertexId, double> distances;
-    unordered_map<VertexId, VertexId> previous;
-    priority_queue<pair<double, VertexId>, vector<pair<double, VertexId>>, greater<>> pq;
-
-    for (auto& pair : adjacency_list) {
-        distances[pair.first] = numeric_limits<double>::max();
-    }
-    distances[start] = 0;
-    pq.push({0, start});
-
-    while (!pq.empty()) {
-        auto [current_dist, current_node] = pq.top();
-        pq.pop();
-        //cout << current_dist << ":" << current_node << endl;
-        if (current_node == end) break;
-
-        if (current_dist > distances[current_node]) continue;
-
-        for (const auto& edge : adjacency_list[current_node]) {
-            //cout << edge.target << endl;
-            double distance_through_current = current_dist + edge.weight;
-            if (distance_through_current < distances[edge.target]) {
-                distances[edge.target] = distance_through_current;
-                previous[edge.target] = current_node;
-                pq.push({distance_through_current, edge.target});
+void Graph::oneToMany(const Endpoint& source, const std::vector<Endpoint>& targets,
+                      double* weights, double* lengths, double* seconds, const CostProfile* profile) const {
+    // 目标锚点的顶点去重排序后用二分判断结算的顶点是否为目标
+    vector<Index> pending;
+    for (const Endpoint& target : targets) {
+        for (uint32_t i = 0; i < target.count; ++i) pending.push_back(target.anchors[i].vertex);
+    }
+    sort(pending.begin(), pending.end());
+    pending.erase(unique(pending.begin(), pending.end()), pending.end());
+    size_t remaining = source.count == 0 ? 0 : pending.size();
+
+    // 长度累计在 workspace(0) 的附加值里，时间借用 workspace(1) 的附加值（与标签一样按下标存放，先写后读）
+    SearchSpace& space = workspace(0);
+    SearchSpace& times = workspace(1);
+    space.reset(vertexCount());
+    times.reset(vertexCount());
+    for (uint32_t i = 0; i < source.count && remaining > 0; ++i) {
+        const Endpoint::Anchor& anchor = source.anchors[i];
+        if (anchor.offset >= space.distance(anchor.vertex)) continue;
+        space.update(anchor.vertex, anchor.offset, anchor.offset, kInvalidIndex);
+        space.setAux(anchor.vertex, anchorLength(anchor, profile));
+        times.setAux(anchor.vertex, anchorSeconds(anchor, profile));
+        space.push(anchor.offset, anchor.vertex);
+    }
+
+    while (!space.empty() && remaining > 0) {
+        auto [current_dist, current_node] = space.pop();
+        if (current_dist > space.distance(current_node)) continue;
+        if (binary_search(pending.begin(), pending.end(), current_node)) --remaining;
+
+        double current_length = space.aux(current_node), current_seconds = times.aux(current_node);
+        for (uint32_t e = offsets_[current_node]; e < offsets_[current_node + 1]; ++e) {
+            Index target = targets_[e];
+            double distance_through_current = current_dist + edgeCost(e, profile);
+            if (distance_through_current < space.distance(target)) {
+                space.update(target, distance_through_current, distance_through_current, current_node);
+                space.setAux(target, current_length + lengths_[e]);
+                times.setAux(target, current_seconds + edgeSeconds(e, profile));
+                space.push(distance_through_current, target);
             }
         }
     }
 
-        // 构建最短路径
-    if (distances[end] == numeric_limits<double>::max()) return {}; // 没有路径
+    for (size_t j = 0; j < targets.size(); ++j) {
+        weights[j] = lengths[j] = seconds[j] = SearchSpace::kInfinity;
+        for (uint32_t i = 0; i < targets[j].count; ++i) {
+            const Endpoint::Anchor& anchor = targets[j].anchors[i];
+            if (!space.reached(anchor.vertex) || space.distance(anchor.vertex) + anchor.offset >= weights[j]) continue;
+            weights[j] = space.distance(anchor.vertex) + anchor.offset;
+            lengths[j] = space.aux(anchor.vertex) + anchorLength(anchor, profile);
+            seconds[j] = times.aux(anchor.vertex) + anchorSeconds(anchor, profile);
+        }
+    }
+}
+
+void Graph::restrictTurns(vector<TurnRestriction> restrictions) {
+    auto byEdges = [](const TurnRestriction& a, const TurnRestriction& b) {
+        return a.from != b.from ? a.from < b.from : a.to < b.to;
+    };
+    sort(restrictions.begin(), restrictions.end(), byEdges);
+    size_t count = 0;
+    for (const TurnRestriction& r : restrictions) {
+        if (count > 0 && restrictions[count - 1].from == r.from && restrictions[count - 1].to == r.to) {
+            restrictions[count - 1].modes |= r.modes;
+        } else {
+            restrictions[count++] = r;
+        }
+    }
+    restrictions.resize(count);
+
+    vector<uint64_t> bits(restrictions.empty() ? 0 : (edgeCount() + 63) / 64, 0);
+    restricted_modes_ = 0;
+    for (const TurnRestriction& r : restrictions) {
+        bits[r.from >> 6] |= uint64_t(1) << (r.from & 63);
+        restricted_modes_ |= uint8_t(r.modes);
+    }
+    turn_restrictions_.assign(std::move(restrictions));
+    restricted_edges_.assign(std::move(bits));
+}
+
+bool Graph::restricts(uint32_t from, uint32_t to, uint8_t mode) const {
+    auto it = lower_bound(turn_restrictions_.begin(), turn_restrictions_.end(), make_pair(from, to),
+                          [](const TurnRestriction& r, const pair<uint32_t, uint32_t>& key) {
+                              return r.from != key.first ? r.from < key.first : r.to < key.second;
+                          });
+    return it != turn_restrictions_.end() && it->from == from && it->to == to && (it->modes & mode);
+}
+
+Graph::Index Graph::edgeSource(uint32_t e) const {
+    return Index(upper_bound(offsets_.begin(), offsets_.end(), e) - offsets_.begin() - 1);
+}
+
+double Graph::lowerBound(Index a, Index b, const CostProfile* profile) const {
+    double scale = profile ? profile->minCostPerMeter() : heuristic_scale_;
+    return calculateDistanceWithLatAndLon(lats_[a], lons_[a], lats_[b], lons_[b]) * scale;
+}
+
+Graph::Index Graph::indexOf(VertexId id) const {
+    auto it = lower_bound(ids_.begin(), ids_.end(), id);
+    if (it == ids_.end() || *it != id) return kInvalidIndex;
+    return Index(it - ids_.begin());
+}
+
+void Graph::save(SnapshotWriter& writer) const {
+    writer.add(sectionTag("GIDS"), ids_.data(), ids_.size());
+    writer.add(sectionTag("GLAT"), lats_.data(), lats_.size());
+    writer.add(sectionTag("GLON"), lons_.data(), lons_.size());
+    writer.add(sectionTag("GOFF"), offsets_.data(), offsets_.size());
+    writer.add(sectionTag("GTGT"), targets_.data(), targets_.size());
+    writer.add(sectionTag("GWGT"), weights_.data(), weights_.size());
+    writer.add(sectionTag("GLEN"), lengths_.data(), lengths_.size());
+    writer.add(sectionTag("GEWY"), edge_ways_.data(), edge_ways_.size());
+    writer.add(sectionTag("GECL"), edge_classes_.data(), edge_classes_.size());
+    writer.add(sectionTag("GEMD"), edge_modes_.data(), edge_modes_.size());
+    writer.add(sectionTag("GECH"), edge_chains_.data(), edge_chains_.size());
+    writer.add(sectionTag("GCOF"), chain_offsets_.data(), chain_offsets_.size());
+    writer.add(sectionTag("GCPT"), chain_points_.data(), chain_points_.size());
+    writer.add(sectionTag("GROF"), rev_offsets_.data(), rev_offsets_.size());
+    writer.add(sectionTag("GRSR"), rev_sources_.data(), rev_sources_.size());
+    writer.add(sectionTag("GRWT"), rev_weights_.data(), rev_weights_.size());
+    writer.add(sectionTag("GRED"), rev_edges_.data(), rev_edges_.size());
+    writer.add(sectionTag("GHSC"), &heuristic_scale_, 1);
+    writer.add(sectionTag("GCMP"), components_.data(), components_.size());
+    writer.add(sectionTag("GTRS"), turn_restrictions_.data(), turn_restrictions_.size());
+    writer.add(sectionTag("GTRB"), restricted_edges_.data(), restricted_edges_.size());
+}
+
+bool Graph::load(const SnapshotReader& reader) {
+    size_t id_count, offset_count, target_count, weight_count;
+    const VertexId* ids = reader.get<VertexId>(sectionTag("GIDS"), id_count);
+    const uint32_t* offsets = reader.get<uint32_t>(sectionTag("GOFF"), offset_count);
+    const Index* targets = reader.get<Index>(sectionTag("GTGT"), target_count);
+    const double* weights = reader.get<double>(sectionTag("GWGT"), weight_count);
+    size_t length_count;
+    const float* lengths = reader.get<float>(sectionTag("GLEN"), length_count);
+    size_t rev_offset_count, rev_source_count, rev_weight_count, scale_count;
+    const uint32_t* rev_offsets = reader.get<uint32_t>(sectionTag("GROF"), rev_offset_count);
+    const Index* rev_sources = reader.get<Index>(sectionTag("GRSR"), rev_source_count);
+    const double* rev_weights = reader.get<double>(sectionTag("GRWT"), rev_weight_count);
+    const double* scale = reader.get<double>(sectionTag("GHSC"), scale_count);
+    if (!ids || !offsets || !targets || !weights || !lengths || length_count != weight_count) return false;
+    if (!rev_offsets || !rev_sources || !rev_weights || !scale || scale_count != 1) return false;
+    if (offset_count != id_count + 1 || target_count != weight_count || offsets[id_count] != target_count) return false;
+    if (rev_offset_count != offset_count || rev_source_count != target_count || rev_weight_count != target_count) return false;
+    size_t component_count;
+    const uint32_t* components = reader.get<uint32_t>(sectionTag("GCMP"), component_count);
+    if (!components || component_count != id_count) return false;
+    size_t lat_count, lon_count;
+    const double* lats = reader.get<double>(sectionTag("GLAT"), lat_count);
+    const double* lons = reader.get<double>(sectionTag("GLON"), lon_count);
+    if (!lats || !lons || lat_count != id_count || lon_count != id_count) return false;
+    size_t edge_way_count;
+    const uint32_t* edge_ways = reader.get<uint32_t>(sectionTag("GEWY"), edge_way_count);
+    if (!edge_ways || edge_way_count != target_count) return false;
+    size_t edge_class_count, edge_mode_count, rev_edge_count;
+    const uint8_t* edge_classes = reader.get<uint8_t>(sectionTag("GECL"), edge_class_count);
+    const uint8_t* edge_modes = reader.get<uint8_t>(sectionTag("GEMD"), edge_mode_count);
+    const uint32_t* rev_edges = reader.get<uint32_t>(sectionTag("GRED"), rev_edge_count);
+    if (!edge_classes || !edge_modes || !rev_edges) return false;
+    if (edge_class_count != target_count || edge_mode_count != target_count || rev_edge_count != target_count) return false;
+    size_t edge_chain_count, chain_offset_count, chain_point_count;
+    const uint32_t* edge_chains = reader.get<uint32_t>(sectionTag("GECH"), edge_chain_count);
+    const uint32_t* chain_offsets = reader.get<uint32_t>(sectionTag("GCOF"), chain_offset_count);
+    const ShapePoint* chain_points = reader.get<ShapePoint>(sectionTag("GCPT"), chain_point_count);
+    if (!edge_chains || !chain_offsets || !chain_points || edge_chain_count != target_count) return false;
+    if (chain_offset_count == 0 || chain_offsets[chain_offset_count - 1] != chain_point_count) return false;
+    size_t restriction_count, restricted_word_count;
+    const TurnRestriction* restrictions = reader.get<TurnRestriction>(sectionTag("GTRS"), restriction_count);
+    const uint64_t* restricted = reader.get<uint64_t>(sectionTag("GTRB"), restricted_word_count);
+    if (!restrictions || !restricted) return false;
+    if (restricted_word_count != (restriction_count == 0 ? 0 : (target_count + 63) / 64)) return false;
+
+    ids_.attach(ids, id_count);
+    lats_.attach(lats, lat_count);
+    lons_.attach(lons, lon_count);
+    offsets_.attach(offsets, offset_count);
+    targets_.attach(targets, target_count);
+    weights_.attach(weights, weight_count);
+    lengths_.attach(lengths, length_count);
+    edge_ways_.attach(edge_ways, edge_way_count);
+    edge_classes_.attach(edge_classes, edge_class_count);
+    edge_modes_.attach(edge_modes, edge_mode_count);
+    edge_chains_.attach(edge_chains, edge_chain_count);
+    chain_offsets_.attach(chain_offsets, chain_offset_count);
+    chain_points_.attach(chain_points, chain_point_count);
+    rev_offsets_.attach(rev_offsets, rev_offset_count);
+    rev_sources_.attach(rev_sources, rev_source_count);
+    rev_weights_.attach(rev_weights, rev_weight_count);
+    rev_edges_.attach(rev_edges, rev_edge_count);
+    components_.attach(components, component_count);
+    turn_restrictions_.attach(restrictions, restriction_count);
+    restricted_edges_.attach(restricted, restricted_word_count);
+    restricted_modes_ = 0;
+    for (const TurnRestriction& r : turn_restrictions_) restricted_modes_ |= uint8_t(r.modes);
+    heuristic_scale_ = *scale;
+    return true;
+}
+
+SearchSpace& Graph::workspace(int slot) {
+    static thread_local SearchSpace spaces[3];
+    return spaces[slot];
+}
+
+void Graph::reserveWorkspaces() const {
+    // 按边搜索的状态包括边和顶点
+    workspace(0).reserve(edgeCount() + vertexCount());
+    workspace(1).reserve(edgeCount() + vertexCount());
+    workspace(2).reserve(vertexCount());
+}
 
+std::vector<long long> Graph::unpack(const SearchSpace& space, Index end) const {
     vector<VertexId> path;
-    for (VertexId at = end; at != start; at = previous[at]) {
-        path.push_back(at);
+    for (Index at = end; at != kInvalidIndex; at = space.parent(at)) {
+        path.push_back(ids_[at]);
     }
-    path.push_back(start);
     reverse(path.begin(), path.end());
-
     return path;
 }
 
-vector<long long> Graph::a_star(VertexId start, VertexId end) {
-    unordered_map<VertexId, double> g_costs; // 从起点到当前节点的实际成本
-    unordered_map<VertexId, double> f_costs; // 实际成本加估计成本
-    unordered_map<VertexId, VertexId> previous;
-    priority_queue<pair<double, VertexId>, vector<pair<double, VertexId>>, greater<>> pq;
+uint32_t Graph::findEdge(Index a, Index b, const CostProfile* profile) const {
+    uint32_t best = kInvalidEdge;
+    double best_cost = SearchSpace::kInfinity;
+    for (uint32_t e = offsets_[a]; e < offsets_[a + 1]; ++e) {
+        if (targets_[e] != b) continue;
+        double cost = edgeCost(e, profile);
+        if (best == kInvalidEdge || cost < best_cost) best = e, best_cost = cost;
+    }
+    return best;
+}
 
-    auto heuristic = [](VertexId a, VertexId b) -> double {
-        // 这里需要实现一个启发式函数，例如曼哈顿距离或欧几里得距离。
-        // 具体实现取决于顶点表示的位置信息。
-        // 返回从a到b的估计成本。
-        return calculateManhattanDistance(nodes[a], nodes[b]); // 默认返回0作为占位符。
-    };
+Endpoint Graph::endpointAt(VertexId id) const {
+    Index v = indexOf(id);
+    return v == kInvalidIndex ? Endpoint{} : Endpoint::at(v);
+}
 
-    for (auto& pair : adjacency_list) {
-        g_costs[pair.first] = numeric_limits<double>::max();
-        f_costs[pair.first] = numeric_limits<double>::max();
+// 同一路段上各段的代价与长度成正比（压缩只合并同一道路上的节点），因此部分代价按长度比例折算
+Endpoint Graph::departure(const RoadPosition& position, const CostProfile* profile) const {
+    Endpoint endpoint;
+    if (usable(position.forward, profile)) {
+        endpoint.anchors[endpoint.count++] = {position.to, (1 - position.fraction) * edgeCost(position.forward, profile),
+                                              position.forward};
     }
-    g_costs[start] = 0;
-    f_costs[start] = heuristic(start, end);
-    pq.push({f_costs[start], start});
+    if (usable(position.backward, profile)) {
+        endpoint.anchors[endpoint.count++] = {position.from, position.fraction * edgeCost(position.backward, profile),
+                                              position.backward};
+    }
+    return endpoint;
+}
 
-    while (!pq.empty()) {
-        auto [current_f_cost, current_node] = pq.top();
-        pq.pop();
+Endpoint Graph::arrival(const RoadPosition& position, const CostProfile* profile) const {
+    Endpoint endpoint;
+    if (usable(position.forward, profile)) {
+        endpoint.anchors[endpoint.count++] = {position.from, position.fraction * edgeCost(position.forward, profile),
+                                              position.forward};
+    }
+    if (usable(position.backward, profile)) {
+        endpoint.anchors[endpoint.count++] = {position.to, (1 - position.fraction) * edgeCost(position.backward, profile),
+                                              position.backward};
+    }
+    return endpoint;
+}
 
-        if (current_node == end) break;
+double Graph::anchorLength(const Endpoint::Anchor& anchor, const CostProfile* profile) const {
+    if (anchor.edge == kInvalidEdge) return 0;
+    double cost = edgeCost(anchor.edge, profile);
+    return cost > 0 ? anchor.offset / cost * lengths_[anchor.edge] : 0;
+}
 
-        if (current_f_cost > f_costs[current_node]) continue;
+double Graph::anchorSeconds(const Endpoint::Anchor& anchor, const CostProfile* profile) const {
+    if (anchor.edge == kInvalidEdge || lengths_[anchor.edge] <= 0) return 0;
+    return anchorLength(anchor, profile) / lengths_[anchor.edge] * edgeSeconds(anchor.edge, profile);
+}
 
-        for (const auto& edge : adjacency_list[current_node]) {
-            double tentative_g_cost = g_costs[current_node] + edge.weight;
-            if (tentative_g_cost < g_costs[edge.target]) {
-                // 找到了更短的路径到edge.target
-                previous[edge.target] = current_node;
-                g_costs[edge.target] = tentative_g_cost;
-                f_costs[edge.target] = g_costs[edge.target] + heuristic(edge.target, end);
-                pq.push({f_costs[edge.target], edge.target});
-            }
+double Graph::alongSegment(const RoadPosition& source, const RoadPosition& target, const CostProfile* profile) const {
+    if (source.forward != target.forward || source.backward != target.backward) return SearchSpace::kInfinity;
+    // 沿路段直走时不可能绕到端点再回来更便宜
+    uint32_t edge = target.fraction >= source.fraction ? source.forward : source.backward;
+    if (!usable(edge, profile)) return SearchSpace::kInfinity;
+    return fabs(target.fraction - source.fraction) * edgeCost(edge, profile);
+}
+
+void Graph::appendShape(uint32_t e, double t0, double t1, Route& route) const {
+    t0 = max(t0, 0.0);
+    t1 = min(t1, 1.0);
+    double meters = (t1 - t0) * lengths_[e];
+    // 换到另一条道路时开始新的一段，起点为当前所在的位置
+    if (route.legs.empty() || route.legs.back().way != edge_ways_[e]) {
+        RouteLeg leg{edge_ways_[e], edge_classes_[e], 0, 0, 0};
+        if (!route.nodes.empty()) leg.lat = route.nodes.back().lat, leg.lon = route.nodes.back().lon;
+        route.legs.push_back(leg);
+    }
+    route.legs.back().meters += meters;
+    route.meters += meters;
+
+    uint32_t chain = edgeChain(e);
+    const ShapePoint* begin = chainBegin(chain);
+    const ShapePoint* end = chainEnd(chain);
+    size_t count = end - begin;
+    bool all = t0 <= 0 && t1 >= 1;
+    double length = lengths_[e];
+    for (size_t i = 0; i < count; ++i) {
+        const ShapePoint& p = edgeReversed(e) ? begin[count - 1 - i] : begin[i];
+        double t = length > 0 ? (edgeReversed(e) ? length - p.offset : p.offset) / length : 0;
+        if (all || (t > t0 && t < t1)) route.nodes.push_back({p.id, p.lat, p.lon});
+    }
+}
+
+void Graph::appendPath(const vector<VertexId>& vertices, Route& route, const CostProfile* profile) const {
+    Index previous = kInvalidIndex;
+    for (VertexId id : vertices) {
+        Index v = indexOf(id);
+        if (previous != kInvalidIndex) {
+            // 搜索沿相邻两点之间代价最小的边前进
+            uint32_t e = findEdge(previous, v, profile);
+            if (e != kInvalidEdge) appendShape(e, 0, 1, route);
         }
+        route.nodes.push_back(node(v));
+        previous = v;
     }
+}
 
-    // 构建最短路径
-    if (f_costs[end] == numeric_limits<double>::max()) return {}; // 没有路径
+void Graph::appendEdges(Index start, const vector<uint32_t>& edges, Route& route) const {
+    route.nodes.push_back(node(start));
+    for (uint32_t e : edges) {
+        appendShape(e, 0, 1, route);
+        route.nodes.push_back(node(targets_[e]));
+    }
+}
 
-    vector<VertexId> path;
-    for (VertexId at = end; at != start; at = previous[at]) {
-        path.push_back(at);
+void Graph::appendDeparture(const RoadPosition& position, Index vertex, Route& route, const CostProfile* profile) const {
+    // 沿正向边到达 to，或沿反向边到达 from；反向边上的比例从 to 起算
+    if (vertex == position.to && usable(position.forward, profile)) {
+        appendShape(position.forward, position.fraction, 1, route);
+    } else if (position.backward != kInvalidEdge) {
+        appendShape(position.backward, 1 - position.fraction, 1, route);
     }
-    path.push_back(start);
-    reverse(path.begin(), path.end());
+}
 
-    return path;
+void Graph::appendArrival(Index vertex, const RoadPosition& position, Route& route, const CostProfile* profile) const {
+    if (vertex == position.from && usable(position.forward, profile)) {
+        appendShape(position.forward, 0, position.fraction, route);
+    } else if (position.backward != kInvalidEdge) {
+        appendShape(position.backward, 0, 1 - position.fraction, route);
+    }
 }
 
-std::vector<long long> Graph::bidirectional_a_star(VertexId start, VertexId end) {
-    using SearchState = std::pair<double, VertexId>;
-    auto heuristic = [](VertexId a, VertexId b) -> double {
-        // 这里需要实现一个启发式函数，例如曼哈顿距离或欧几里得距离。
-        // 具体实现取决于顶点表示的位置信息。
-        // 返回从a到b的估计成本。
-        return calculateManhattanDistance(nodes[a], nodes[b]); // 默认返回0作为占位符。
-    };
-    // 正向搜索结构
-    std::unordered_map<VertexId, double> forward_g_costs;
-    std::unordered_map<VertexId, double> forward_f_costs;
-    std::unordered_map<VertexId, VertexId> forward_previous;
-    std::priority_queue<SearchState, std::vector<SearchState>, std::greater<>> forward_pq;
-
-    // 反向搜索结构
-    std::unordered_map<VertexId, double> backward_g_costs;
-    std::unordered_map<VertexId, double> backward_f_costs;
-    std::unordered_map<VertexId, VertexId> backward_previous;
-    std::priority_queue<SearchState, std::vector<SearchState>, std::greater<>> backward_pq;
-
-    // 初始化正向搜索
-    forward_g_costs[start] = 0.0;
-    forward_f_costs[start] = heuristic(start, end);
-    forward_pq.push({forward_f_costs[start], start});
-
-    // 初始化反向搜索
-    backward_g_costs[end] = 0.0;
-    backward_f_costs[end] = heuristic(end, start);
-    backward_pq.push({backward_f_costs[end], end});
-
-    while (!forward_pq.empty() && !backward_pq.empty()) {
-        if (search_meets(forward_previous, backward_previous, forward_f_costs, backward_f_costs)) break;
-
-        // 执行一次正向搜索步骤
-        auto [current_f_cost, current_node] = forward_pq.top();
-        forward_pq.pop();
-
-        for (const auto& edge : adjacency_list[current_node]) {
-            double tentative_g_cost = forward_g_costs[current_node] + edge.weight;
-            if (tentative_g_cost < forward_g_costs[edge.target]) {
-                forward_previous[edge.target] = current_node;
-                forward_g_costs[edge.target] = tentative_g_cost;
-                forward_f_costs[edge.target] = tentative_g_cost + heuristic(edge.target, end);
-                forward_pq.push({forward_f_costs[edge.target], edge.target});
+void Graph::appendAlong(const RoadPosition& source, const RoadPosition& target, Route& route) const {
+    if (target.fraction >= source.fraction) {
+        appendShape(source.forward, source.fraction, target.fraction, route);
+    } else {
+        appendShape(source.backward, 1 - source.fraction, 1 - target.fraction, route);
+    }
+}
+
+    // Dijkstra算法用于查找最短路径
+vector<long long> Graph::dijkstra(const Endpoint& source, const Endpoint& target, const CostProfile* profile) const {
+    SearchSpace& space = workspace(0);
+    space.reset(vertexCount());
+    for (uint32_t i = 0; i < source.count; ++i) {
+        const Endpoint::Anchor& anchor = source.anchors[i];
+        if (anchor.offset >= space.distance(anchor.vertex)) continue;
+        space.update(anchor.vertex, anchor.offset, anchor.offset, kInvalidIndex);
+        space.push(anchor.offset, anchor.vertex);
+    }
+
+    // 终点锚点带有 offset，结算到它们时只记录候选，直到堆顶不再小于候选
+    double best = SearchSpace::kInfinity;
+    Index end = kInvalidIndex;
+    while (!space.empty()) {
+        auto [current_dist, current_node] = space.pop();
+        if (current_dist >= best) break;
+
+        if (current_dist > space.distance(current_node)) continue;
+
+        for (uint32_t i = 0; i < target.count; ++i) {
+            if (target.anchors[i].vertex == current_node && current_dist + target.anchors[i].offset < best) {
+                best = current_dist + target.anchors[i].offset;
+                end = current_node;
             }
         }
 
-        // 执行一次反向搜索步骤
-        auto [back_current_f_cost, back_current_node] = backward_pq.top();
-        backward_pq.pop();
-
-        for (const auto& edge : adjacency_list[back_current_node]) {
-            double tentative_g_cost = backward_g_costs[back_current_node] + edge.weight;
-            if (tentative_g_cost < backward_g_costs[edge.target]) {
-                backward_previous[edge.target] = back_current_node;
-                backward_g_costs[edge.target] = tentative_g_cost;
-                backward_f_costs[edge.target] = tentative_g_cost + heuristic(edge.target, start);
-                backward_pq.push({backward_f_costs[edge.target], edge.target});
+        for (uint32_t e = offsets_[current_node]; e < offsets_[current_node + 1]; ++e) {
+            Index next = targets_[e];
+            double distance_through_current = current_dist + edgeCost(e, profile);
+            if (distance_through_current < space.distance(next)) {
+                space.update(next, distance_through_current, distance_through_current, current_node);
+                space.push(distance_through_current, next);
             }
         }
     }
 
     // 构建最短路径
-    return reconstruct_path(forward_previous, backward_previous, start, end);
+    if (end == kInvalidIndex) return {}; // 没有路径
+    return unpack(space, end);
 }
 
-bool Graph::search_meets(std::unordered_map<VertexId, VertexId>& forward_prev,
-                         std::unordered_map<VertexId, VertexId>& backward_prev,
-                         std::unordered_map<VertexId, double>& forward_f_costs,
-                         std::unordered_map<VertexId, double>& backward_f_costs) {
-    for (auto& [node, _] : forward_prev) {
-        if (backward_prev.find(node) != backward_prev.end()) {
-            return true;
+vector<long long> Graph::a_star(const Endpoint& source, const Endpoint& target, const CostProfile* profile) const {
+    // 球面距离按每米的最小代价折算，保证启发函数可采纳；多个终点锚点取最小值仍是一致的
+    return a_star(source, target, [this, &target, profile](Index v) {
+        double h = SearchSpace::kInfinity;
+        for (uint32_t i = 0; i < target.count; ++i) {
+            h = min(h, lowerBound(v, target.anchors[i].vertex, profile) + target.anchors[i].offset);
+        }
+        return h;
+    }, profile);
+}
+
+void Graph::distancesFrom(Index source, bool reverse, std::vector<double>& distances) const {
+    const Column<uint32_t>& offsets = reverse ? rev_offsets_ : offsets_;
+    const Column<Index>& neighbors = reverse ? rev_sources_ : targets_;
+    const Column<double>& weights = reverse ? rev_weights_ : weights_;
+
+    SearchSpace& space = workspace(0);
+    space.reset(vertexCount());
+    space.update(source, 0, 0, kInvalidIndex);
+    space.push(0, source);
+
+    while (!space.empty()) {
+        auto [current_dist, current_node] = space.pop();
+        if (current_dist > space.distance(current_node)) continue;
+
+        for (uint32_t e = offsets[current_node]; e < offsets[current_node + 1]; ++e) {
+            Index target = neighbors[e];
+            double distance_through_current = current_dist + weights[e];
+            if (distance_through_current < space.distance(target)) {
+                space.update(target, distance_through_current, distance_through_current, current_node);
+                space.push(distance_through_current, target);
+            }
         }
     }
-    return false;
+
+    distances.resize(vertexCount());
+    for (Index v = 0; v < vertexCount(); ++v) distances[v] = space.distance(v);
 }
 
-std::vector<long long> Graph::reconstruct_path(
-    std::unordered_map<VertexId, VertexId>& forward_previous,
-    std::unordered_map<VertexId, VertexId>& backward_previous,
-    VertexId start, VertexId end) {
-
-    // 查找交汇点
-    VertexId meet_point;
-    for (auto& [node, _] : forward_previous) {
-        if (backward_previous.find(node) != backward_previous.end()) {
-            meet_point = node;
-            break;
+// 双向 A*：采用平均势函数 p_f(v) = (π_t(v) - π_s(v)) / 2，p_r(v) = -p_f(v)。
+// 两个方向的约化边权都非负，相当于在约化图上做双向 Dijkstra；
+// 用 mu 记录目前最短的相遇路径，当两侧堆顶之和不小于 mu 时即可停止，得到的路径是最优的。
+// 两端有多个锚点时，π_s / π_t 取经各锚点（加上 offset）的最小下界，仍然一致。
+std::vector<long long> Graph::bidirectional_a_star(const Endpoint& source, const Endpoint& target,
+                                                   const CostProfile* profile) const {
+    if (source.count == 0 || target.count == 0) return {};
+
+    auto forward_potential = [this, &source, &target, profile](Index v) -> double {
+        double to_target = SearchSpace::kInfinity, from_source = SearchSpace::kInfinity;
+        for (uint32_t i = 0; i < target.count; ++i) {
+            to_target = min(to_target, lowerBound(v, target.anchors[i].vertex, profile) + target.anchors[i].offset);
+        }
+        for (uint32_t i = 0; i < source.count; ++i) {
+            from_source = min(from_source, lowerBound(source.anchors[i].vertex, v, profile) + source.anchors[i].offset);
+        }
+        return (to_target - from_source) / 2;
+    };
+    SearchSpace& forward = workspace(0);
+    SearchSpace& backward = workspace(1);
+    forward.reset(vertexCount());
+    backward.reset(vertexCount());
+
+    // key = 实际成本 + 势函数；标签中 key - distance 即为该点的势，无需重复计算
+    auto seed = [](SearchSpace& space, const Endpoint& endpoint, auto potential) {
+        for (uint32_t i = 0; i < endpoint.count; ++i) {
+            const Endpoint::Anchor& anchor = endpoint.anchors[i];
+            if (anchor.offset >= space.distance(anchor.vertex)) continue;
+            double key = anchor.offset + potential(anchor.vertex);
+            space.update(anchor.vertex, anchor.offset, key, kInvalidIndex);
+            space.push(key, anchor.vertex);
+        }
+    };
+    seed(forward, source, forward_potential);
+    seed(backward, target, [&](Index v) { return -forward_potential(v); });
+
+    double mu = numeric_limits<double>::max();
+    Index meet_point = kInvalidIndex;
+    // 两端共享的锚点本身就是一条相遇路径
+    for (uint32_t i = 0; i < source.count; ++i) {
+        Index v = source.anchors[i].vertex;
+        if (backward.reached(v) && forward.distance(v) + backward.distance(v) < mu) {
+            mu = forward.distance(v) + backward.distance(v);
+            meet_point = v;
         }
     }
 
-    if (forward_previous.find(meet_point) == forward_previous.end() ||
-        backward_previous.find(meet_point) == backward_previous.end()) {
-        return {}; // 没有找到路径
+    // 弹出并丢弃过期的堆顶，使堆顶反映真实的最小 key
+    auto dropStale = [](SearchSpace& space) {
+        while (!space.empty() && space.top().first > space.key(space.top().second)) space.pop();
+    };
+
+    while (true) {
+        dropStale(forward);
+        dropStale(backward);
+        if (forward.empty() || backward.empty()) break;
+        if (forward.top().first + backward.top().first >= mu) break;
+
+        // 每次扩展堆顶较小的一侧
+        bool expand_forward = forward.top().first <= backward.top().first;
+        SearchSpace& space = expand_forward ? forward : backward;
+        const SearchSpace& other = expand_forward ? backward : forward;
+        const Column<uint32_t>& offsets = expand_forward ? offsets_ : rev_offsets_;
+        const Column<Index>& neighbors = expand_forward ? targets_ : rev_sources_;
+        const Column<double>& weights = expand_forward ? weights_ : rev_weights_;
+        double sign = expand_forward ? 1.0 : -1.0;
+        // 反向 CSR 的第 i 项按代价配置计价时要找回对应的正向边
+        auto cost = [&](uint32_t i) {
+            if (!profile) return weights[i];
+            return edgeCost(expand_forward ? i : rev_edges_[i], profile);
+        };
+
+        Index current_node = space.pop().second;
+        double current_g_cost = space.distance(current_node);
+        for (uint32_t e = offsets[current_node]; e < offsets[current_node + 1]; ++e) {
+            Index next = neighbors[e];
+            double tentative_g_cost = current_g_cost + cost(e);
+            if (tentative_g_cost < space.distance(next)) {
+                double potential = space.reached(next) ? space.key(next) - space.distance(next)
+                                                       : sign * forward_potential(next);
+                space.update(next, tentative_g_cost, tentative_g_cost + potential, current_node);
+                space.push(tentative_g_cost + potential, next);
+                // 另一侧已到达该点时更新最短相遇路径
+                if (other.reached(next) && tentative_g_cost + other.distance(next) < mu) {
+                    mu = tentative_g_cost + other.distance(next);
+                    meet_point = next;
+                }
+            }
+        }
     }
 
-    // 构建正向路径
-    std::vector<VertexId> forward_path;
-    for (VertexId at = meet_point; at != start; at = forward_previous[at]) {
-        forward_path.push_back(at);
+    if (meet_point == kInvalidIndex) return {}; // 没有找到路径
+    return reconstruct_path(forward, backward, meet_point);
+}
+
+// 按边搜索的状态是"沿某条边到达它的终点"，正向标签 g 为从起点到此的代价，反向标签 h 为从此到终点的代价，
+// 两个方向在同一状态上相遇时总代价为 g + h。只有作为转向限制起点的边（计入掉头代价时为所有边）
+// 需要各自的状态 [0, E)；沿其他边到达顶点 v 之后往哪里转都不受限制，这些边共用顶点状态 E + v，
+// 因此没有限制的路段上搜索与按顶点搜索相同，状态数只比顶点数多出受限制的边。
+// 状态的势取所在顶点的势，转向代价非负，约化后的边权仍然非负，停止条件与按顶点的双向 A* 相同
+std::vector<long long> Graph::turn_aware(const Endpoint& source, const Endpoint& target, const CostProfile* profile,
+                                         vector<uint32_t>* edges) const {
+    if (edges) edges->clear();
+    if (source.count == 0 || target.count == 0) return {};
+
+    const uint8_t mode = profile ? uint8_t(profile->mode) : uint8_t(kCar);
+    const double u_turn = profile ? profile->uTurnCost() : 0;
+    const uint32_t edge_count = uint32_t(edgeCount());
+    const bool any_restricted = u_turn > 0 || !restricted_edges_.empty();
+    auto restricted = [&](uint32_t e) {
+        return u_turn > 0 || (!restricted_edges_.empty() && (restricted_edges_[e >> 6] >> (e & 63) & 1));
+    };
+    auto stateOf = [&](uint32_t e) { return restricted(e) ? e : edge_count + targets_[e]; };
+    auto vertexOf = [&](uint32_t state) { return state < edge_count ? targets_[state] : Index(state - edge_count); };
+    // 从边 in 转到边 out 的附加代价，禁止的转向为无穷大；同一路段的反向边即为掉头
+    auto turnCost = [&](uint32_t in, uint32_t out) {
+        if (!turnAllowed(in, out, mode)) return SearchSpace::kInfinity;
+        return u_turn > 0 && out != in && edgeChain(out) == edgeChain(in) ? u_turn : 0.0;
+    };
+    auto vertex_potential = [this, &source, &target, profile](Index v) -> double {
+        double to_target = SearchSpace::kInfinity, from_source = SearchSpace::kInfinity;
+        for (uint32_t i = 0; i < target.count; ++i) {
+            to_target = min(to_target, lowerBound(v, target.anchors[i].vertex, profile) + target.anchors[i].offset);
+        }
+        for (uint32_t i = 0; i < source.count; ++i) {
+            from_source = min(from_source, lowerBound(source.anchors[i].vertex, v, profile) + source.anchors[i].offset);
+        }
+        return (to_target - from_source) / 2;
+    };
+    // 标签的附加值记下状态与前驱之间所走的边：正向为到达该状态的边，反向为离开该状态的边
+    SearchSpace& forward = workspace(0);
+    SearchSpace& backward = workspace(1);
+    forward.reset(edgeCount() + vertexCount());
+    backward.reset(edgeCount() + vertexCount());
+    // 一个顶点的各个状态共用该顶点的势，按顶点缓存以免重复计算球面距离
+    SearchSpace& potentials = workspace(2);
+    potentials.reset(vertexCount());
+    auto forward_potential = [&](Index v) {
+        if (!potentials.reached(v)) potentials.update(v, vertex_potential(v), 0, kInvalidIndex);
+        return potentials.distance(v);
+    };
+
+    double mu = numeric_limits<double>::max();
+    uint32_t meet = kInvalidEdge;
+    auto improve = [&](SearchSpace& space, const SearchSpace& other, uint32_t state, double dist, double potential,
+                       uint32_t parent, uint32_t edge) {
+        if (dist >= space.distance(state)) return;
+        space.update(state, dist, dist + potential, parent);
+        space.setAux(state, edge);
+        space.push(dist + potential, state);
+        if (other.reached(state) && dist + other.distance(state) < mu) {
+            mu = dist + other.distance(state);
+            meet = state;
+        }
+    };
+    // 正向：沿边 f 走到它的终点
+    auto arrive = [&](uint32_t f, double dist, uint32_t parent) {
+        improve(forward, backward, stateOf(f), dist, forward_potential(targets_[f]), parent, f);
+    };
+    // 反向：从 f 的起点 u 出发走完 f 到终点的代价为 dist，写入 u 处所有可以接着驶入 f 的状态
+    auto precede = [&](uint32_t f, Index u, double dist, uint32_t parent) {
+        double potential = -forward_potential(u);
+        improve(backward, forward, edge_count + u, dist, potential, parent, f);
+        if (!any_restricted) return;
+        for (uint32_t slot = rev_offsets_[u]; slot < rev_offsets_[u + 1]; ++slot) {
+            uint32_t e = rev_edges_[slot];
+            if (!restricted(e) || !usable(e, profile)) continue;
+            double turn = turnCost(e, f);
+            if (turn != SearchSpace::kInfinity) improve(backward, forward, e, dist + turn, potential, parent, f);
+        }
+    };
+
+    // 起点锚点带着吸附所在的边时，从"沿这条边到达锚点"出发，第一次转向也要检查；该边只走了一部分，不算在路径里
+    for (uint32_t i = 0; i < source.count; ++i) {
+        const Endpoint::Anchor& anchor = source.anchors[i];
+        uint32_t state = anchor.edge == kInvalidEdge ? edge_count + anchor.vertex : stateOf(anchor.edge);
+        improve(forward, backward, state, anchor.offset, forward_potential(anchor.vertex), kInvalidEdge, kInvalidEdge);
+    }
+    // 终点锚点带着边时，到达锚点后还要能转到这条边上
+    for (uint32_t i = 0; i < target.count; ++i) {
+        const Endpoint::Anchor& anchor = target.anchors[i];
+        if (anchor.edge != kInvalidEdge) {
+            precede(anchor.edge, anchor.vertex, anchor.offset, kInvalidEdge);
+            continue;
+        }
+        double potential = -forward_potential(anchor.vertex);
+        improve(backward, forward, edge_count + anchor.vertex, anchor.offset, potential, kInvalidEdge, kInvalidEdge);
+        for (uint32_t slot = rev_offsets_[anchor.vertex]; slot < rev_offsets_[anchor.vertex + 1]; ++slot) {
+            uint32_t e = rev_edges_[slot];
+            if (restricted(e)) improve(backward, forward, e, anchor.offset, potential, kInvalidEdge, kInvalidEdge);
+        }
     }
-    forward_path.push_back(start);
-    std::reverse(forward_path.begin(), forward_path.end());
+    auto dropStale = [](SearchSpace& space) {
+        while (!space.empty() && space.top().first > space.key(space.top().second)) space.pop();
+    };
+    while (true) {
+        dropStale(forward);
+        dropStale(backward);
+        if (forward.empty() || backward.empty()) break;
+        if (forward.top().first + backward.top().first >= mu) break;
+
+        if (forward.top().first <= backward.top().first) {
+            uint32_t state = forward.pop().second;
+            double g = forward.distance(state);
+            Index v = vertexOf(state);
+            for (uint32_t f = offsets_[v]; f < offsets_[v + 1]; ++f) {
+                double cost = edgeCost(f, profile);
+                if (cost == SearchSpace::kInfinity) continue;
+                double turn = state < edge_count ? turnCost(state, f) : 0;
+                if (turn != SearchSpace::kInfinity) arrive(f, g + turn + cost, state);
+            }
+        } else {
+            uint32_t state = backward.pop().second;
+            double h = backward.distance(state);
+            if (state < edge_count) {
+                precede(state, edgeSource(state), h + edgeCost(state, profile), state);
+                continue;
+            }
+            // 顶点状态代表所有没有限制的入边
+            Index w = state - edge_count;
+            for (uint32_t slot = rev_offsets_[w]; slot < rev_offsets_[w + 1]; ++slot) {
+                uint32_t e = rev_edges_[slot];
+                if (restricted(e)) continue;
+                double cost = edgeCost(e, profile);
+                if (cost != SearchSpace::kInfinity) precede(e, rev_sources_[slot], h + cost, state);
+            }
+        }
+    }
+
+    if (meet == kInvalidEdge) return {}; // 没有找到路径
 
-    // 构建反向路径
-    std::vector<VertexId> backward_path;
-    for (VertexId at = meet_point; at != end; at = backward_previous[at]) {
-        backward_path.push_back(at);
+    // 两个方向各自的起始状态所记的边（吸附所在的边）不属于路径
+    vector<uint32_t> path;
+    uint32_t first = meet;
+    for (uint32_t s = meet; forward.parent(s) != kInvalidEdge; s = forward.parent(s)) {
+        path.push_back(uint32_t(forward.aux(s)));
+        first = forward.parent(s);
+    }
+    reverse(path.begin(), path.end());
+    for (uint32_t s = meet; backward.parent(s) != kInvalidEdge; s = backward.parent(s)) {
+        path.push_back(uint32_t(backward.aux(s)));
     }
-    backward_path.push_back(end);
 
-    // 合并路径
-    forward_path.insert(forward_path.end(), backward_path.begin(), backward_path.end());
-    return forward_path;
-}
\ No newline at end of file
+    vector<VertexId> vertices{ids_[vertexOf(first)]};
+    for (uint32_t e : path) vertices.push_back(ids_[targets_[e]]);
+    if (edges) *edges = std::move(path);
+    return vertices;
+}
+
+std::vector<long long> Graph::reconstruct_path(
+    const SearchSpace& forward, const SearchSpace& backward, Index meet_point) const {
+
+    // 构建正向路径：起点到交汇点
+    std::vector<VertexId> path = unpack(forward, meet_point);
+
+    // 反向搜索的前驱指向终点方向，沿前驱走到终点
+    for (Index at = backward.parent(meet_point); at != kInvalidIndex; at = backward.parent(at)) {
+        path.push_back(ids_[at]);
+    }
+    return path;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "graph.hpp"
+
+// ALT（A*, Landmarks, Triangle inequality）
+//
+// 加载时选出若干地标 L，并用 Dijkstra 预先算出每个顶点到地标、地标到每个顶点的距离。
+// 由三角不等式，d(v, t) >= d(L, t) - d(L, v) 且 d(v, t) >= d(v, L) - d(t, L)，
+// 对所有地标取最大值即得到比球面距离紧得多、且一致的启发函数。
+class Landmarks {
+public:
+    using Index = Graph::Index;
+    using VertexId = Graph::VertexId;
+
+    static constexpr uint32_t kDefaultCount = 8;
+
+    // 以“最远点”策略选择地标：每次选取离已有地标最远的顶点
+    void build(const Graph& graph, uint32_t count = kDefaultCount);
+    bool empty() const { return count_ == 0; }
+
+    // v 到 t 的代价下界
+    double lowerBound(Index v, Index t) const;
+
+    std::vector<VertexId> query(const Graph& graph, const Endpoint& source, const Endpoint& target) const;
+    std::vector<VertexId> query(const Graph& graph, VertexId start, VertexId end) const {
+        return query(graph, graph.endpointAt(start), graph.endpointAt(end));
+    }
+
+    void save(SnapshotWriter& writer) const;
+    bool load(const SnapshotReader& reader);
+
+private:
+    uint32_t count_ = 0;
+    Column<Index> landmarks_;
+    // 按顶点存放：第 v 行的 count_ 个值连续，一次启发函数计算只读一两条缓存行
+    Column<float> from_;   // from_[v * count_ + i] = d(L_i, v)
+    Column<float> to_;     // to_[v * count_ + i]   = d(v, L_i)
+    // float 存储带来的舍入误差上界，从结果中减去以保持可采纳
+    double slack_ = 0;
+};
+
+inline Landmarks landmarks;
@@ -0,0 +1,92 @@
+#pragma once
+#include "graph.hpp"
+
+// Contraction Hierarchies
+//
+// 预处理：按重要性从低到高逐个收缩顶点，若 u -> v -> w 是 u 到 w 的唯一最短路，
+// 收缩 v 时添加捷径 u -> w（记录中间点 v）。收缩顺序即顶点的 rank。
+// 查询：正反两侧都只沿 rank 升高的边搜索，得到的路径再把捷径逐层展开为原始节点序列。
+class ContractionHierarchy {
+public:
+    using Index = Graph::Index;
+    using VertexId = Graph::VertexId;
+
+    void build(const Graph& graph);
+    bool empty() const { return rank_.empty(); }
+
+    // 与 Graph::dijkstra 相同的输入输出：两端的锚点，返回 OSM 节点ID构成的路径
+    std::vector<VertexId> query(const Graph& graph, const Endpoint& source, const Endpoint& target) const;
+    std::vector<VertexId> query(const Graph& graph, VertexId start, VertexId end) const {
+        return query(graph, graph.endpointAt(start), graph.endpointAt(end));
+    }
+
+    // 从 origin 的锚点出发沿上行边的完整搜索（正向或反向），对每个结算且未被剪枝的顶点
+    // 调用 visit(v, weight, length)，锚点的部分路段计入其中；用于桶式多对多查询
+    template <typename Visit>
+    void upwardSearch(const Graph& graph, const Endpoint& origin, bool forward, Visit visit) const;
+
+    void save(SnapshotWriter& writer) const;
+    bool load(const SnapshotReader& reader);
+
+private:
+    // 一条上行边；middle 为被收缩的中间点，原始边为 kInvalidIndex
+    struct Arc {
+        Index other;
+        Index middle;
+        double weight;
+        double length;
+    };
+
+    Column<Index> rank_;
+    // 正向上行边：v -> other，rank[other] > rank[v]
+    Column<uint32_t> up_offsets_;
+    Column<Arc> up_arcs_;
+    // 反向上行边：other -> v（原方向），rank[other] > rank[v]
+    Column<uint32_t> down_offsets_;
+    Column<Arc> down_arcs_;
+
+    // 找到原方向 a -> b 的那条边（可能是捷径）
+    const Arc* findArc(Index a, Index b) const;
+    void unpackArc(const Graph& graph, Index a, Index b, std::vector<VertexId>& path) const;
+};
+
+template <typename Visit>
+void ContractionHierarchy::upwardSearch(const Graph& graph, const Endpoint& origin, bool forward, Visit visit) const {
+    const Column<uint32_t>& offsets = forward ? up_offsets_ : down_offsets_;
+    const Column<Arc>& arcs = forward ? up_arcs_ : down_arcs_;
+    const Column<uint32_t>& opposite_offsets = forward ? down_offsets_ : up_offsets_;
+    const Column<Arc>& opposite_arcs = forward ? down_arcs_ : up_arcs_;
+
+    SearchSpace& space = Graph::workspace(forward ? 0 : 1);
+    space.reset(rank_.size());
+    for (uint32_t i = 0; i < origin.count; ++i) {
+        const Endpoint::Anchor& anchor = origin.anchors[i];
+        if (anchor.offset >= space.distance(anchor.vertex)) continue;
+        space.update(anchor.vertex, anchor.offset, anchor.offset, Graph::kInvalidIndex);
+        space.setAux(anchor.vertex, graph.anchorLength(anchor));
+        space.push(anchor.offset, anchor.vertex);
+    }
+    while (!space.empty()) {
+        auto [dist, v] = space.pop();
+        if (dist > space.distance(v)) continue;
+
+        bool stalled = false;
+        for (uint32_t i = opposite_offsets[v]; i < opposite_offsets[v + 1] && !stalled; ++i) {
+            stalled = space.distance(opposite_arcs[i].other) + opposite_arcs[i].weight < dist;
+        }
+        if (stalled) continue;
+        visit(v, dist, space.aux(v));
+
+        for (uint32_t i = offsets[v]; i < offsets[v + 1]; ++i) {
+            const Arc& arc = arcs[i];
+            double d = dist + arc.weight;
+            if (d < space.distance(arc.other)) {
+                space.update(arc.other, d, d, v);
+                space.setAux(arc.other, space.aux(v) + arc.length);
+                space.push(d, arc.other);
+            }
+        }
+    }
+}
+
+inline ContractionHierarchy hierarchy;
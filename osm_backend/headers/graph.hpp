@@ -1,3 +1,4 @@
+#pragma once
 #include <iostream>
 #include <string>
 #include <memory>
@@ -8,156 +9,443 @@
 #include <algorithm>
 #include <queue>
 #include <limits>
+#include <cstdint>
 #include "pugixml.hpp"
+#include "profile.hpp"
 
 #define M_PI		3.14159265358979323846
 
 using namespace std;
 
+class SnapshotWriter;
+class SnapshotReader;
+
 struct Node {
     long long id;
     double lat, lon;
 };
 
-struct Edge {
-    long long target;   // 目标节点ID
-    double weight; // 边的权重（例如距离）
-
-    Edge(long long t, double w) : target(t), weight(w) {}
+// 路段的形状点：压缩进路段内部、不作为图顶点的道路节点
+struct ShapePoint {
+    long long id;
+    double lat, lon;
+    double offset;   // 沿路段到路段起点的距离（米）
 };
 
-struct Way {
-    long long id;
-    bool oneway;
-    double speedLimit;
-    std::string highwayType;
-    std::string name;
-    std::vector<long long> node_ids; // 节点ID列表
+// 图中预先写入的边权 = 长度(米) / 限速(km/h)，即驾车最快路线的代价，乘以该系数得到行驶时间(秒)；
+// 其他代价配置（profile.hpp）在查询时由边长和道路等级现算
+constexpr double kSecondsPerWeightUnit = 3.6;
 
+// 列存储：数据要么由自己持有，要么直接指向快照映射的内存
+template <typename T>
+class Column {
+public:
+    Column() = default;
+    Column(const Column&) = delete;
+    Column& operator=(const Column&) = delete;
+    Column(Column&&) = default;
+    Column& operator=(Column&&) = default;
+
+    void assign(std::vector<T>&& values) {
+        owned_ = std::move(values);
+        data_ = owned_.data();
+        size_ = owned_.size();
+    }
+    void attach(const T* data, size_t size) {
+        owned_ = std::vector<T>();
+        data_ = data;
+        size_ = size;
+    }
+
+    const T& operator[](size_t i) const { return data_[i]; }
+    const T* data() const { return data_; }
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+private:
+    std::vector<T> owned_;
+    const T* data_ = nullptr;
+    size_t size_ = 0;
 };
 
-class Graph {
+// 按稠密下标存放的搜索状态，每个线程各自复用一份。
+// 每次查询只递增 generation_，标记不等于当前代的标签视为未访问，因此重置是 O(1)。
+class SearchSpace {
 public:
-    using VertexId = long long;
-    using EdgeList = vector<Edge>;
-    using AdjacencyList = unordered_map<VertexId, EdgeList>;
+    using Index = uint32_t;
+    static constexpr Index kNone = std::numeric_limits<Index>::max();
+    static constexpr double kInfinity = std::numeric_limits<double>::max();
 
-    void addEdge(VertexId from, VertexId to, double weight);
+    void reserve(size_t vertex_count) {
+        if (labels_.size() < vertex_count) labels_.resize(vertex_count);
+        if (aux_.size() < vertex_count) aux_.resize(vertex_count);
+        heap_.reserve(vertex_count);
+    }
+
+    void reset(size_t vertex_count) {
+        if (labels_.size() < vertex_count) labels_.resize(vertex_count);
+        if (!aux_.empty() && aux_.size() < vertex_count) aux_.resize(vertex_count);
+        heap_.clear();
+        if (++generation_ == 0) {
+            // 代号回绕时才真正清零一次
+            for (auto& label : labels_) label.stamp = 0;
+            generation_ = 1;
+        }
+    }
+
+    bool reached(Index v) const { return labels_[v].stamp == generation_; }
+    double distance(Index v) const { return reached(v) ? labels_[v].dist : kInfinity; }
+    double key(Index v) const { return reached(v) ? labels_[v].key : kInfinity; }
+    Index parent(Index v) const { return reached(v) ? labels_[v].parent : kNone; }
+
+    void update(Index v, double dist, double key, Index parent) {
+        labels_[v] = {dist, key, parent, generation_};
+    }
+
+    // 附加值（例如沿最短路累计的长度），只在需要的搜索里使用，随标签一起失效
+    double aux(Index v) const { return aux_[v]; }
+    void setAux(Index v, double value) {
+        if (aux_.size() < labels_.size()) aux_.resize(labels_.size());
+        aux_[v] = value;
+    }
+
+    // 累计结算次数（出堆且未过期的项），不随 reset 清零；查询前后相减即得本次结算的顶点数
+    uint64_t popCount() const { return pops_; }
+
+    // 二叉堆（允许重复入堆，出堆时与标签里的 key 比较来跳过过期项）
+    bool empty() const { return heap_.empty(); }
+    void push(double key, Index v) {
+        heap_.push_back({key, v});
+        std::push_heap(heap_.begin(), heap_.end(), std::greater<>());
+    }
+    std::pair<double, Index> top() const { return heap_.front(); }
+    std::pair<double, Index> pop() {
+        std::pop_heap(heap_.begin(), heap_.end(), std::greater<>());
+        auto entry = heap_.back();
+        heap_.pop_back();
+        // 与各搜索跳过过期项的条件一致：入堆时的 key 大于标签里的 key 即已过期
+        if (entry.first <= key(entry.second)) ++pops_;
+        return entry;
+    }
 
-    // Dijkstra算法用于查找最短路径
-    vector<VertexId> dijkstra(VertexId start, VertexId end);
-    vector<VertexId> a_star(VertexId start, VertexId end);
-    std::vector<VertexId> bidirectional_a_star(VertexId start, VertexId end);
-    std::vector<VertexId> reconstruct_path(
-    std::unordered_map<VertexId, VertexId>& forward_previous,
-    std::unordered_map<VertexId, VertexId>& backward_previous,
-    VertexId start, VertexId end);
 private:
-    AdjacencyList adjacency_list;
-    bool search_meets(std::unordered_map<VertexId, VertexId>& forward_prev,
-                      std::unordered_map<VertexId, VertexId>& backward_prev,
-                      std::unordered_map<VertexId, double>& forward_f_costs,
-                      std::unordered_map<VertexId, double>& backward_f_costs);
+    struct Label {
+        double dist;
+        double key;
+        Index parent;
+        uint32_t stamp;
+    };
+    std::vector<Label> labels_;
+    std::vector<double> aux_;
+    std::vector<std::pair<double, Index>> heap_;
+    uint32_t generation_ = 0;
+    uint64_t pops_ = 0;
+};
+
+// 吸附到路网上的位置：落在顶点 from 与 to 之间的路段上，fraction 为投影点沿路段离 from 的长度比例；
+// forward / backward 为该路段 from -> to 与 to -> from 方向的边，不允许通行的方向为 Graph::kInvalidEdge
+struct RoadPosition {
+    uint32_t from, to;
+    uint32_t forward, backward;
+    double fraction;
+    double lat, lon;   // 投影点
+    double meters;     // 查询点到投影点的距离
 };
 
+// 沿同一条道路连续行驶的一段路程
+struct RouteLeg {
+    uint32_t way;        // 道路在 way_table 中的下标
+    uint8_t road_class;
+    double lat, lon;     // 驶入这条道路的位置
+    double meters;
+};
 
+// 展开后的路线：途经的全部道路节点，以及按道路合并的各段路程；
+// 总长度在展开过程中累加，不含起终点吸附时离开路网的距离。行驶时间由各段长度按代价配置的速度折算
+struct Route {
+    std::vector<Node> nodes;
+    std::vector<RouteLeg> legs;
+    double meters = 0;
+};
 
-// 计算两个地理坐标之间的距离（简化版）
-double calculateDistance(const Node& from, const Node& to);
-double calculateDistanceWithLatAndLon(double lat1, double lat2, double lon1, double lon2);
-long long findNearestNode(double targetLat, double targetLon);
+// 搜索的一端。位置落在路段中间时可以从路段的两个端点出发（或到达），
+// offset 是吸附点与该端点之间那部分边权；落在顶点上时只有一个 offset 为 0 的锚点。
+// edge 为吸附位置所在的边：出发时沿它到达锚点，到达时从锚点沿它离开，按边搜索据此检查锚点处的转向；
+// 锚点就是顶点时为无效边
+struct Endpoint {
+    struct Anchor {
+        uint32_t vertex;
+        double offset;
+        uint32_t edge = std::numeric_limits<uint32_t>::max();
+    };
+    Anchor anchors[2];
+    uint32_t count = 0;
+
+    static Endpoint at(uint32_t vertex) { return {{{vertex, 0}}, 1}; }
+};
+
+// 转向限制：禁止 modes 中的出行方式从边 from 驶入路口后转到边 to
+struct TurnRestriction {
+    uint32_t from, to;
+    uint32_t modes;
+};
 
-class KDTree {
+// 冻结后的图：OSM 节点ID重映射为 32 位稠密下标，边按 CSR 连续存放。
+// 顶点只有路口和道路端点，两者之间度为 2 的节点压缩为一条边，其坐标作为形状点存放在路段里，
+// 一条路段对应正反两个方向至多两条边
+class Graph {
 public:
-    struct Point {
-        double lat, lon;
-        long long id;
+    using VertexId = long long;   // OSM 节点ID
+    using Index = uint32_t;       // 稠密顶点下标
+    static constexpr Index kInvalidIndex = std::numeric_limits<Index>::max();
 
-        // 比较函数用于排序，这里只提供了一个示例，根据实际情况修改
-        bool operator<(const Point& other) const {
-            return std::tie(lat, lon, id) < std::tie(other.lat, other.lon, other.id);
-        }
-    };
+    // 构建阶段：先收集路段，全部加入后调用 freeze() 生成 CSR。路段从 from 经 shape 中的形状点到 to，
+    // length 为沿形状的总长度（米），way 为所属道路在 way_table 中的下标，road_class 为其道路等级；
+    // forward_modes / backward_modes 为正反方向允许的出行方式，非空的方向各添加一条边，
+    // 驾车不能通行的边写入无穷大的边权。coordinates 按 ID 升序排列，须包含所有路段的端点，其余节点被忽略
+    void addChain(VertexId from, VertexId to, double weight, double length, uint32_t way, uint8_t road_class,
+                  const std::vector<ShapePoint>& shape, uint8_t forward_modes, uint8_t backward_modes);
+    void freeze(const std::vector<Node>& coordinates);
+    // 冻结后写入转向限制（由 OSM 的 type=restriction 关系解析而来），重复的限制合并
+    void restrictTurns(std::vector<TurnRestriction> restrictions);
 
-    KDTree() : root_(nullptr), depth_(0) {}
+    size_t vertexCount() const { return ids_.size(); }
+    size_t edgeCount() const { return targets_.size(); }
+    // OSM ID 与下标互转；ID 按升序存放，查找为二分
+    Index indexOf(VertexId id) const;
+    VertexId idOf(Index v) const { return ids_[v]; }
+    double latOf(Index v) const { return lats_[v]; }
+    double lonOf(Index v) const { return lons_[v]; }
+    Node node(Index v) const { return {ids_[v], lats_[v], lons_[v]}; }
 
-    void insert(const Point& point) {
-        root_ = insertRec(std::move(root_), point, 0);
+    // 顶点 v 的出边编号范围为 [edgeBegin(v), edgeEnd(v))
+    uint32_t edgeBegin(Index v) const { return offsets_[v]; }
+    uint32_t edgeEnd(Index v) const { return offsets_[v + 1]; }
+    Index edgeTarget(uint32_t e) const { return targets_[e]; }
+    // 边的起点：在 offsets_ 中二分
+    Index edgeSource(uint32_t e) const;
+    // 顶点 v 的入边为 inEdge(i)，i 取 [inEdgeBegin(v), inEdgeEnd(v))
+    uint32_t inEdgeBegin(Index v) const { return rev_offsets_[v]; }
+    uint32_t inEdgeEnd(Index v) const { return rev_offsets_[v + 1]; }
+    uint32_t inEdge(uint32_t i) const { return rev_edges_[i]; }
+    double edgeWeight(uint32_t e) const { return weights_[e]; }
+    double edgeLength(uint32_t e) const { return lengths_[e]; }
+    uint32_t edgeWay(uint32_t e) const { return edge_ways_[e]; }
+    uint8_t edgeClass(uint32_t e) const { return edge_classes_[e]; }
+    uint8_t edgeModes(uint32_t e) const { return edge_modes_[e]; }
+    // 边在代价配置 profile 下的代价，该配置的出行方式不能通行时为无穷大；profile 为空时即预先写入的边权
+    double edgeCost(uint32_t e, const CostProfile* profile) const {
+        if (!profile) return weights_[e];
+        if (!(edge_modes_[e] & profile->mode)) return SearchSpace::kInfinity;
+        return profile->cost(edge_classes_[e], lengths_[e]);
+    }
+    // 边所在的路段，以及边的方向是否与路段的正方向相反
+    uint32_t edgeChain(uint32_t e) const { return edge_chains_[e] >> 1; }
+    bool edgeReversed(uint32_t e) const { return edge_chains_[e] & 1; }
+    // 路段 c 的形状点按正方向为 [chainBegin(c), chainEnd(c))
+    size_t chainCount() const { return chain_offsets_.empty() ? 0 : chain_offsets_.size() - 1; }
+    const ShapePoint* chainBegin(uint32_t c) const { return chain_points_.data() + chain_offsets_[c]; }
+    const ShapePoint* chainEnd(uint32_t c) const { return chain_points_.data() + chain_offsets_[c + 1]; }
+    // mode 方式能否从边 from 转到边 to；没有限制的边只查一次位图
+    bool turnAllowed(uint32_t from, uint32_t to, uint8_t mode) const {
+        if (restricted_edges_.empty() || !(restricted_edges_[from >> 6] >> (from & 63) & 1)) return true;
+        return !restricts(from, to, mode);
     }
-    long long findNearestNode(double targetLat, double targetLon) const {
-        Point bestPoint;
-        double minDistSquared = std::numeric_limits<double>::max();
-        nearestNeighborSearch(root_.get(), targetLat, targetLon, 0, minDistSquared, bestPoint);
+    // 是否有对 mode 生效的转向限制
+    bool hasTurnRestrictions(uint8_t mode) const { return restricted_modes_ & mode; }
+    // a -> b 中代价最小的一条边，不存在时返回 kInvalidEdge
+    static constexpr uint32_t kInvalidEdge = std::numeric_limits<uint32_t>::max();
+    uint32_t findEdge(Index a, Index b, const CostProfile* profile = nullptr) const;
+
+    // 以 OSM ID 表示的顶点作为搜索一端；ID 不在图中时没有锚点
+    Endpoint endpointAt(VertexId id) const;
+    // 从路段上的位置出发 / 到达：沿允许的方向走到路段两端，按比例计入部分代价。
+    // 以下各函数的 profile 为空时使用预先写入的边权
+    Endpoint departure(const RoadPosition& position, const CostProfile* profile = nullptr) const;
+    Endpoint arrival(const RoadPosition& position, const CostProfile* profile = nullptr) const;
+    // 锚点的 offset 所对应的那部分路段长度（米）/ 行驶时间（秒）；锚点就是顶点时为 0
+    double anchorLength(const Endpoint::Anchor& anchor, const CostProfile* profile = nullptr) const;
+    double anchorSeconds(const Endpoint::Anchor& anchor, const CostProfile* profile = nullptr) const;
+    // 走完边 e 所需的秒数：profile 为空时按预先写入的边权换算，否则按 profile 的速度
+    double edgeSeconds(uint32_t e, const CostProfile* profile = nullptr) const {
+        return profile ? profile->seconds(edge_classes_[e], lengths_[e]) : weights_[e] * kSecondsPerWeightUnit;
+    }
+    // 两个位置在同一路段上且可以沿路段直接到达时返回所需代价，否则返回无穷大
+    double alongSegment(const RoadPosition& source, const RoadPosition& target,
+                        const CostProfile* profile = nullptr) const;
+
+    // 沿边 e 的行进方向走过长度比例 [t0, t1] 的部分：其间的形状点依次追加到 route.nodes，
+    // 走过的长度计入 route 与当前道路的路程；t0 <= 0 且 t1 >= 1 时为整条边
+    void appendShape(uint32_t e, double t0, double t1, Route& route) const;
+    // 搜索得到的顶点序列（OSM ID）展开到 route：相邻顶点之间插入所用边的形状点
+    void appendPath(const std::vector<VertexId>& vertices, Route& route, const CostProfile* profile = nullptr) const;
+    // 按边搜索得到的边序列展开到 route，start 为第一条边的起点
+    void appendEdges(Index start, const std::vector<uint32_t>& edges, Route& route) const;
+    // 从吸附位置走到搜索起点 vertex / 从搜索终点 vertex 走到吸附位置 / 同一路段上两个位置之间
+    void appendDeparture(const RoadPosition& position, Index vertex, Route& route,
+                         const CostProfile* profile = nullptr) const;
+    void appendArrival(Index vertex, const RoadPosition& position, Route& route,
+                       const CostProfile* profile = nullptr) const;
+    void appendAlong(const RoadPosition& source, const RoadPosition& target, Route& route) const;
+
+    // 弱连通分量编号，按分量大小降序，0 为最大的分量
+    uint32_t componentOf(Index v) const { return components_[v]; }
+
+    // 从 source 出发的单源最短距离（reverse 为真时沿反向边，即到 source 的距离），不可达为无穷大
+    void distancesFrom(Index source, bool reverse, std::vector<double>& distances) const;
+
+    // 一对多 Dijkstra：所有目标的锚点都结算后停止；没有锚点或不可达的目标得到无穷大。
+    // seconds 为按 profile 的速度算出的行驶时间，按时间计费且没有代价倍率时与代价成正比，其他配置需要单独累计
+    void oneToMany(const Endpoint& source, const std::vector<Endpoint>& targets,
+                   double* weights, double* lengths, double* seconds,
+                   const CostProfile* profile = nullptr) const;
+
+    // 从 a 到 b 的代价下界：球面距离乘以每米的最小代价（预先写入的边权取图中最小的 边权/距离 比）
+    double lowerBound(Index a, Index b, const CostProfile* profile = nullptr) const;
+
+    // 当前线程的搜索状态；slot 0 / 1 区分双向搜索的两个方向，slot 2 供按边搜索缓存顶点的势
+    static SearchSpace& workspace(int slot);
+    // 按本图规模预先分配当前线程的搜索状态，之后的查询不再扩容
+    void reserveWorkspaces() const;
 
-        return bestPoint.id;
+    // Dijkstra算法用于查找最短路径。返回从某个起点锚点到某个终点锚点的顶点序列，
+    // 加上两端的 offset 后总代价最小；profile 非空时边的代价按该配置现算
+    vector<VertexId> dijkstra(const Endpoint& source, const Endpoint& target,
+                              const CostProfile* profile = nullptr) const;
+    vector<VertexId> a_star(const Endpoint& source, const Endpoint& target,
+                            const CostProfile* profile = nullptr) const;
+    // 使用自定义启发函数的 A*；heuristic(v) 必须是 v 到终点（含终点 offset）代价的下界
+    template <typename Heuristic>
+    std::vector<VertexId> a_star(const Endpoint& source, const Endpoint& target, Heuristic heuristic,
+                                 const CostProfile* profile = nullptr) const;
+    std::vector<VertexId> bidirectional_a_star(const Endpoint& source, const Endpoint& target,
+                                               const CostProfile* profile = nullptr) const;
+    // 按边的双向 A*：搜索状态是"沿某条边到达路口"，因此可以检查每次转向是否被限制，
+    // 并计入代价配置中的掉头代价。图本身不展开，只有受限制的边在搜索时有各自的状态，其余仍按顶点搜索。
+    // 返回的顶点序列与其他搜索相同，edges 非空时另外给出相邻顶点之间实际所走的边
+    std::vector<VertexId> turn_aware(const Endpoint& source, const Endpoint& target,
+                                     const CostProfile* profile = nullptr,
+                                     std::vector<uint32_t>* edges = nullptr) const;
+
+    vector<VertexId> dijkstra(VertexId start, VertexId end) const {
+        return dijkstra(endpointAt(start), endpointAt(end));
+    }
+    vector<VertexId> a_star(VertexId start, VertexId end) const {
+        return a_star(endpointAt(start), endpointAt(end));
+    }
+    std::vector<VertexId> bidirectional_a_star(VertexId start, VertexId end) const {
+        return bidirectional_a_star(endpointAt(start), endpointAt(end));
     }
 
+    // 以 CSR 形式读写快照（见 snapshot.hpp）；load 直接引用映射内存，不做拷贝
+    void save(SnapshotWriter& writer) const;
+    bool load(const SnapshotReader& reader);
 private:
-    struct Node {
-        Point point;
-        std::unique_ptr<Node> left, right;
+    struct PendingEdge {
+        VertexId from, to;
+        double weight;
+        double length;
+        uint32_t way;
+        uint32_t chain;   // 路段编号 << 1 | 是否与路段方向相反
+        uint8_t road_class;
+        uint8_t modes;
     };
+    std::vector<PendingEdge> pending_;
+    std::vector<uint32_t> pending_chain_offsets_{0};
+    std::vector<ShapePoint> pending_chain_points_;
 
-    std::unique_ptr<Node> root_;
-    size_t depth_;
+    Column<VertexId> ids_;      // 下标 -> OSM ID
+    Column<double> lats_;       // 顶点坐标，与 ids_ 一样按下标存放
+    Column<double> lons_;
+    Column<uint32_t> offsets_;  // 顶点 v 的出边为 [offsets_[v], offsets_[v + 1])
+    Column<Index> targets_;
+    Column<double> weights_;
+    Column<float> lengths_;     // 边长（米），用于返回路程
+    Column<uint32_t> edge_ways_;  // 边所属道路在 way_table 中的下标
+    Column<uint8_t> edge_classes_;   // 边的道路等级
+    Column<uint8_t> edge_modes_;     // 边允许的出行方式
+    Column<uint32_t> edge_chains_;   // 路段编号 << 1 | 是否与路段方向相反
+    // 路段 c 的形状点为 chain_points_[chain_offsets_[c]..chain_offsets_[c + 1])
+    Column<uint32_t> chain_offsets_;
+    Column<ShapePoint> chain_points_;
+    // 反向 CSR：顶点 v 的入边为 [rev_offsets_[v], rev_offsets_[v + 1])，供反向搜索使用
+    Column<uint32_t> rev_offsets_;
+    Column<Index> rev_sources_;
+    Column<double> rev_weights_;
+    Column<uint32_t> rev_edges_;   // 反向 CSR 中每一项对应的正向边，用于按代价配置现算边权
+    Column<uint32_t> components_;
+    // 转向限制按 (from, to) 排序；restricted_edges_ 是以边编号为下标的位图，标出作为 from 出现过的边
+    Column<TurnRestriction> turn_restrictions_;
+    Column<uint64_t> restricted_edges_;
+    uint8_t restricted_modes_ = 0;
+    // 每米距离对应的最小边权，用于构造可采纳且一致的启发函数
+    double heuristic_scale_ = 0;
 
-    // 返回类型为 std::unique_ptr<Node>, 参数为右值引用
-    std::unique_ptr<Node> insertRec(std::unique_ptr<Node> node, const Point& point, size_t depth) {
-        if (!node) {
-            // 使用 new 创建 Node 对象，并用 std::unique_ptr 包装它
-            return std::make_unique<Node>(Node{point, nullptr, nullptr});
-        }
+    bool restricts(uint32_t from, uint32_t to, uint8_t mode) const;
+    bool usable(uint32_t e, const CostProfile* profile) const {
+        return e != kInvalidEdge && edgeCost(e, profile) != SearchSpace::kInfinity;
+    }
+
+    // 沿前驱从 end 回溯到搜索的起点（前驱为 kInvalidIndex 的锚点）
+    std::vector<VertexId> unpack(const SearchSpace& space, Index end) const;
+    std::vector<VertexId> reconstruct_path(
+        const SearchSpace& forward, const SearchSpace& backward, Index meet_point) const;
+};
 
-        size_t cd = depth % 2; // 假设我们交替使用纬度和经度来分割空间
-        if (cd == 0 ? point.lat < node->point.lat : point.lon < node->point.lon) {
-            node->left = insertRec(std::move(node->left), point, depth + 1);
-        } else {
-            node->right = insertRec(std::move(node->right), point, depth + 1);
-        }
 
-        return node;
+
+// 计算两个地理坐标之间的距离（简化版）
+double calculateDistance(const Node& from, const Node& to);
+double calculateDistanceWithLatAndLon(double lat1, double lon1, double lat2, double lon2);
+
+template <typename Heuristic>
+std::vector<Graph::VertexId> Graph::a_star(const Endpoint& source, const Endpoint& target, Heuristic heuristic,
+                                           const CostProfile* profile) const {
+    // distance 为从起点到当前节点的实际成本，key 为实际成本加估计成本
+    SearchSpace& space = workspace(0);
+    space.reset(vertexCount());
+    for (uint32_t i = 0; i < source.count; ++i) {
+        const Endpoint::Anchor& anchor = source.anchors[i];
+        if (anchor.offset >= space.distance(anchor.vertex)) continue;
+        double start_f_cost = anchor.offset + heuristic(anchor.vertex);
+        space.update(anchor.vertex, anchor.offset, start_f_cost, kInvalidIndex);
+        space.push(start_f_cost, anchor.vertex);
     }
 
-    // 递归查找最近邻点
-    void nearestNeighborSearch(Node* node, double targetLat, double targetLon, size_t depth,
-                               double& minDistSquared, Point& bestPoint) const {
-        if (!node) return;
+    // 到达终点锚点时只记录候选，直到堆顶的估计值不再小于它
+    double best = SearchSpace::kInfinity;
+    Index end = kInvalidIndex;
+    while (!space.empty()) {
+        auto [current_f_cost, current_node] = space.pop();
+        if (current_f_cost >= best) break;
 
-        // 更新当前最佳点
-        double distSquared = calculateDistanceWithLatAndLon(targetLat, targetLon, node->point.lat, node->point.lon);
-        if (distSquared < minDistSquared) {
-            minDistSquared = distSquared;
-            bestPoint = node->point;
-        }
+        if (current_f_cost > space.key(current_node)) continue;
 
-        // 决定先访问哪个子树
-        size_t cd = depth % 2;
-        Node* nextBranch = nullptr;
-        Node* oppositeBranch = nullptr;
-
-        if (cd == 0 ? targetLat < node->point.lat : targetLon < node->point.lon) {
-            nextBranch = node->left.get();
-            oppositeBranch = node->right.get();
-        } else {
-            nextBranch = node->right.get();
-            oppositeBranch = node->left.get();
+        double current_g_cost = space.distance(current_node);
+        for (uint32_t i = 0; i < target.count; ++i) {
+            if (target.anchors[i].vertex == current_node && current_g_cost + target.anchors[i].offset < best) {
+                best = current_g_cost + target.anchors[i].offset;
+                end = current_node;
+            }
         }
 
-        // 先递归进入更可能包含最近点的子树
-        nearestNeighborSearch(nextBranch, targetLat, targetLon, depth + 1, minDistSquared, bestPoint);
-
-        // 检查是否需要检查另一个子树
-        double distToSplitPlane = (cd == 0 ? targetLat - node->point.lat : targetLon - node->point.lon);
-        if (distToSplitPlane * distToSplitPlane < minDistSquared) {
-            nearestNeighborSearch(oppositeBranch, targetLat, targetLon, depth + 1, minDistSquared, bestPoint);
+        for (uint32_t e = offsets_[current_node]; e < offsets_[current_node + 1]; ++e) {
+            Index next = targets_[e];
+            double tentative_g_cost = current_g_cost + edgeCost(e, profile);
+            if (tentative_g_cost < space.distance(next)) {
+                // 找到了更短的路径到next；key - distance 即该点的启发值，不必重复计算
+                double h = space.reached(next) ? space.key(next) - space.distance(next) : heuristic(next);
+                space.update(next, tentative_g_cost, tentative_g_cost + h, current_node);
+                space.push(tentative_g_cost + h, next);
+            }
         }
     }
-    // 辅助函数如计算距离等...
-};
 
-inline std::unordered_map<long long, Node> nodes;
-inline std::unordered_map<long long, Node> false_nodes;
-inline std::vector<Way> ways;
+    // 构建最短路径
+    if (end == kInvalidIndex) return {}; // 没有路径
+    return unpack(space, end);
+}
+
 inline Graph graph;
-inline std::unordered_map<long long, Way> on_way;
-inline KDTree kdtree;
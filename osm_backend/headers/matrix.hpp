@@ -0,0 +1,24 @@
+#pragma once
+#include "graph.hpp"
+#include "parallel.hpp"
+
+// 多对多行程矩阵
+//
+// 有收缩层次时使用桶式算法：先对每个目标做一次反向上行搜索，把 (目标, 距离) 记在经过的顶点的桶里；
+// 再对每个源做一次正向上行搜索，在结算的顶点上扫描桶即可得到到所有目标的最短距离。
+// 否则（包括非默认的代价配置，收缩层次只按默认配置预处理）退化为每个源一次一对多 Dijkstra。
+// 两种方式都把各个源分给常驻线程池并行计算。
+struct TravelMatrix {
+    size_t rows = 0, cols = 0;
+    // 按行存放：[i * cols + j] 为第 i 个源到第 j 个目标；不可达为 SearchSpace::kInfinity
+    std::vector<double> weights;
+    std::vector<double> lengths;
+    std::vector<double> seconds;   // 按代价配置的速度算出的行驶时间
+};
+
+// 调用线程和 pool 中的常驻线程一起计算；pool 为空时只用调用线程
+// 源和目标都是按同一 profile 吸附位置的锚点（见 Graph::departure / arrival），没有锚点的一端整行 / 整列不可达；
+// 不处理起终点在同一路段上、可以沿路段直接到达的情况。profile 为空时使用预先写入的边权
+TravelMatrix computeTravelMatrix(const std::vector<Endpoint>& sources,
+                                 const std::vector<Endpoint>& targets,
+                                 TaskPool* pool = nullptr, const CostProfile* profile = nullptr);
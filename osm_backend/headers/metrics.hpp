@@ -0,0 +1,109 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// 请求指标
+//
+// 工作线程每处理完一个请求只往无锁环形缓冲区里写一条定长记录，不加锁也不做 IO；
+// 后台线程定期取出记录，累加到计数器和延迟直方图里（可选地批量写出请求日志），
+// /metrics 以 Prometheus 文本格式输出汇总结果。
+
+enum class Algorithm : uint8_t { Dijkstra, AStar, Bidirectional, Alt, Ch, TurnAware, Matrix, Count };
+
+const char* algorithmName(Algorithm algorithm);
+
+struct RequestRecord {
+    Algorithm algorithm;
+    bool found;
+    uint32_t settled;      // 搜索结算的顶点数，不含过期的堆项（/matrix 不统计）
+    uint32_t path_nodes;   // 路径节点数；/matrix 为矩阵单元数
+    double path_meters;
+    double snap_ms;        // 最近节点查找耗时
+    double search_ms;
+};
+
+// 定长的多生产者单消费者队列：每个槽位带序号，生产者用 CAS 抢占位置，满时直接返回 false
+class RecordRing {
+public:
+    explicit RecordRing(size_t capacity);
+
+    bool push(const RequestRecord& record);
+    // 只能由单个消费者线程调用
+    bool pop(RequestRecord& record);
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        RequestRecord record;
+    };
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) size_t tail_ = 0;
+};
+
+// 固定桶边界（毫秒）的累积直方图
+struct LatencyHistogram {
+    static constexpr double kBounds[] = {0.1, 0.25, 0.5, 1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000, 2500};
+    static constexpr size_t kBucketCount = sizeof(kBounds) / sizeof(kBounds[0]);
+
+    uint64_t buckets[kBucketCount + 1] = {};  // 最后一个桶是 +Inf
+    uint64_t count = 0;
+    double sum = 0;
+
+    void observe(double value);
+};
+
+class Metrics {
+public:
+    Metrics();
+    ~Metrics() { stop(); }
+
+    // 启动后台汇总线程；log_requests 为 true 时每条记录输出一行日志
+    void start(bool log_requests);
+    void stop();
+
+    // 工作线程调用，无锁；缓冲区满时丢弃记录并计数
+    void record(const RequestRecord& record);
+    void recordError() { errors_.fetch_add(1, std::memory_order_relaxed); }
+
+    // Prometheus 文本格式
+    std::string render();
+
+private:
+    struct Totals {
+        uint64_t requests = 0;
+        uint64_t not_found = 0;
+        uint64_t settled = 0;
+        uint64_t path_nodes = 0;
+        double path_meters = 0;
+        LatencyHistogram snap_ms;
+        LatencyHistogram search_ms;
+    };
+
+    static constexpr size_t kRingCapacity = 1 << 14;
+
+    RecordRing ring_;
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> errors_{0};
+
+    // 只在后台线程和 render() 之间共享
+    std::mutex totals_mutex_;
+    Totals totals_[size_t(Algorithm::Count)];
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool running_ = false;
+    bool log_requests_ = false;
+    std::thread flusher_;
+
+    void drain();
+    void run();
+};
+
+inline Metrics metrics;
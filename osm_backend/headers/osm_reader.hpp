@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+
+// 读取 OSM 数据（XML 或 PBF）：不建立 DOM，按文件顺序把节点、道路和关系逐个交给处理器
+
+struct OsmWay {
+    long long id = 0;
+    std::vector<long long> node_refs;                          // 节点引用（XML 中的 <nd ref=...>）
+    std::vector<std::pair<std::string, std::string>> tags;     // 标签（XML 中的 <tag k=... v=...>）
+};
+
+struct OsmMember {
+    enum Type : uint8_t { kNode, kWay, kRelation };
+    Type type = kNode;
+    long long ref = 0;
+    std::string role;
+};
+
+struct OsmRelation {
+    long long id = 0;
+    std::vector<OsmMember> members;
+    std::vector<std::pair<std::string, std::string>> tags;
+};
+
+class OsmHandler {
+public:
+    virtual ~OsmHandler() = default;
+
+    virtual void node(long long /*id*/, double /*lat*/, double /*lon*/) {}
+    virtual void way(const OsmWay& /*way*/) {}
+    virtual void relation(const OsmRelation& /*relation*/) {}
+};
+
+// 缓存一段输入中的元素，之后按原来的顺序交给真正的处理器；并行解析时每个块各用一个
+class BufferedOsmHandler : public OsmHandler {
+public:
+    struct NodeRecord {
+        long long id;
+        double lat, lon;
+    };
+    std::vector<NodeRecord> nodes;
+    std::vector<OsmWay> ways;
+    std::vector<OsmRelation> relations;
+
+    void node(long long id, double lat, double lon) override { nodes.push_back({id, lat, lon}); }
+    void way(const OsmWay& way) override { ways.push_back(way); }
+    void relation(const OsmRelation& relation) override { relations.push_back(relation); }
+
+    // OSM 文件中依次是节点、道路、关系，块内按这个顺序重放即为原来的顺序
+    void replay(OsmHandler& handler) const {
+        for (const auto& n : nodes) handler.node(n.id, n.lat, n.lon);
+        for (const auto& w : ways) handler.way(w);
+        for (const auto& r : relations) handler.relation(r);
+    }
+};
+
+// 按扩展名选择格式：.pbf 为 PBF，其余按 XML 读取
+bool readOsm(const std::string& path, OsmHandler& handler, unsigned threads = 0);
+
+// 映射整个文件，在顶层元素之间切成若干块由多个线程分批并行解析，每批再按文件顺序把元素交给处理器后释放，
+// 因此回调顺序与线程数无关，且都在调用线程上执行，缓存的元素不超过一批。threads 为 0 时使用硬件并发数。
+// 返回 false 表示文件无法打开或格式错误（此前各批的元素已交给处理器）
+bool readOsmXml(const std::string& path, OsmHandler& handler, unsigned threads = 0);
+
+// PBF：先扫描出所有数据块，再由多个线程并行解压、解码（支持 DenseNodes 和 zlib 压缩），
+// 按文件顺序交给处理器。不支持的压缩格式或必需特性会使读取失败
+bool readOsmPbf(const std::string& path, OsmHandler& handler, unsigned threads = 0);
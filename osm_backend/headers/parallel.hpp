@@ -0,0 +1,123 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 把 [0, count) 分给若干线程，每个线程不断领取下一个下标；threads 为 0 时使用硬件并发数。
+// 调用方负责让各个 task(i) 只写各自的结果
+template <typename Task>
+void parallelFor(size_t count, unsigned threads, Task task) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = unsigned(std::min<size_t>(threads, count));
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i = next++; i < count; i = next++) task(i);
+    };
+    if (threads <= 1) {
+        worker();
+        return;
+    }
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& th : pool) th.join();
+}
+
+// 常驻线程池：线程在构造时启动，各自先执行一次 init（例如预分配线程局部的搜索状态），之后反复领取任务。
+// 多个请求共用一个池，同时并行计算的线程数因此不超过池的大小，也不会每次请求都新建线程
+class TaskPool {
+public:
+    explicit TaskPool(unsigned threads, std::function<void()> init = {}) {
+        for (unsigned t = 0; t < threads; ++t) {
+            workers_.emplace_back([this, init] {
+                if (init) init();
+                run();
+            });
+        }
+    }
+    ~TaskPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        ready_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    size_t size() const { return workers_.size(); }
+    void enqueue(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        ready_.notify_one();
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> jobs_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    bool stopping_ = false;
+
+    void run() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                if (jobs_.empty()) return;
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job();
+        }
+    }
+};
+
+// 与上面相同，但由调用线程和 pool 中的常驻线程一起领取下标。调用线程领完所有下标后只等待已经开始的帮手，
+// 池被其他请求占满时调用线程独自完成，仍在排队的帮手开始时发现已经结束就直接返回
+template <typename Task>
+void parallelFor(size_t count, TaskPool& pool, Task task) {
+    struct State {
+        std::atomic<size_t> next{0};
+        size_t count;
+        std::function<void(size_t)> task;
+        std::mutex mutex;
+        std::condition_variable idle;
+        size_t active = 0;
+        bool closed = false;
+    };
+    auto state = std::make_shared<State>();
+    state->count = count;
+    state->task = [&task](size_t i) { task(i); };
+    auto drain = [](State& s) {
+        for (size_t i = s.next++; i < s.count; i = s.next++) s.task(i);
+    };
+
+    size_t helpers = std::min(pool.size(), count > 0 ? count - 1 : 0);
+    for (size_t h = 0; h < helpers; ++h) {
+        pool.enqueue([state, drain] {
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (state->closed) return;
+                ++state->active;
+            }
+            drain(*state);
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (--state->active == 0) state->idle.notify_all();
+        });
+    }
+    drain(*state);
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->closed = true;
+    state->idle.wait(lock, [&] { return state->active == 0; });
+}
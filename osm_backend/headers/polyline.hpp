@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "graph.hpp"
+
+// 路线几何的输出
+//
+// 编码折线与 Google Encoded Polyline 算法一致：坐标乘以 10^precision 取整后对前一点做差分，
+// 差值 zigzag 编码后按每 5 位一组的变长整数写出，每组加 63 落在可打印的 ASCII 范围内，
+// 前端可以直接用常见的 polyline 解码库还原。先纬度后经度。
+std::string encodePolyline(const std::vector<Node>& points, int precision = 5);
+
+// Douglas-Peucker 化简：保留首尾点，删去离保留折线不超过 tolerance 米的点
+std::vector<Node> simplifyPolyline(const std::vector<Node>& points, double tolerance);
+
+// 缩放级别 zoom 下一个屏幕像素（256 像素瓦片）在纬度 lat 处对应的米数，作为化简的容差
+double toleranceForZoom(int zoom, double lat);
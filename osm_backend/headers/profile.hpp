@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// 道路等级：由 highway 标签归类，图的每条边只存一个字节的等级编号，
+// 查询时按等级查一张小表即可算出任意代价配置下的边权
+enum RoadClass : uint8_t {
+    kMotorway,
+    kTrunk,
+    kPrimary,
+    kSecondary,
+    kTertiary,
+    kUnclassified,
+    kResidential,
+    kService,
+    kOtherRoad,
+    kRoadClassCount
+};
+
+// 出行方式，按位组合成每条边允许的方式集合
+enum TravelMode : uint8_t {
+    kCar = 1,
+    kBike = 2,
+    kFoot = 4,
+    kAllModes = kCar | kBike | kFoot
+};
+
+// "car"、"bike"、"foot"；名称未知时返回 0
+TravelMode travelModeByName(std::string_view name);
+
+// 由道路的标签推出各出行方式的通行权：forward 为沿节点顺序方向允许的方式，backward 为逆向。
+// 先按 highway 取默认值，再依次应用 access、vehicle、motor_vehicle / motorcar、bicycle、foot 标签，
+// 单行（oneway、junction=roundabout）只约束车辆，oneway:bicycle=no 等标签允许自行车逆行
+struct WayAccess {
+    uint8_t forward = 0;
+    uint8_t backward = 0;
+};
+WayAccess wayAccessOf(const std::vector<std::pair<std::string, std::string>>& tags);
+
+RoadClass roadClassOf(std::string_view highway);
+// 请求中用来指定等级的名称，与 highway 标签值一致；other 表示其余所有道路
+const char* roadClassName(RoadClass road_class);
+// 名称不是任何等级时返回 kRoadClassCount
+RoadClass roadClassByName(std::string_view name);
+
+// 代价配置：一种出行方式，加上每个等级一个速度（km/h）和一个代价倍率。按时间计费时边的代价为
+// 长度 / 速度 × 倍率，按距离计费时为 长度 × 倍率；速度为 0 的等级禁止通行。
+// 行驶时间总是按速度计算，与计费方式和倍率无关
+struct CostProfile {
+    enum Objective : uint8_t { kTime, kDistance };
+
+    TravelMode mode = kCar;
+    Objective objective = kTime;
+    double speed[kRoadClassCount];
+    double penalty[kRoadClassCount];
+    double u_turn = 0;   // 掉头的附加时间（秒），只在按边搜索时计入
+
+    bool allows(uint8_t road_class) const { return speed[road_class] > 0; }
+    // 不允许通行时返回 SearchSpace::kInfinity
+    double cost(uint8_t road_class, double meters) const;
+    double seconds(uint8_t road_class, double meters) const;
+    // 每米的最小代价，乘以球面距离即为可采纳的启发值
+    double minCostPerMeter() const;
+    // 掉头一次的附加代价；按距离计费时不计
+    double uTurnCost() const;
+
+    bool operator==(const CostProfile& other) const;
+    bool operator!=(const CostProfile& other) const { return !(*this == other); }
+
+    // 默认配置：驾车最快路线，与加载时写入图中的边权一致，CH / ALT / 矩阵都按它预处理
+    static const CostProfile& fastest();
+    // 某种出行方式的最快路线，使用该方式的默认速度
+    static CostProfile forMode(TravelMode mode);
+    // 按名称取 mode 方式的预设配置："fastest"、"shortest"、"avoid-highway"；名称未知时返回 false
+    static bool named(std::string_view name, TravelMode mode, CostProfile& profile);
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include "graph.hpp"
+
+// 路段网格索引
+//
+// 图中的每条路段（不分方向）沿其形状点切成若干直线段。线段端点按局部等距圆柱投影换算成以米为单位的平面坐标，
+// 并登记到其包围盒覆盖的所有网格单元里。查询时从查询点所在的单元一圈圈向外扩展，
+// 当下一圈离查询点的最近距离已不小于当前最优值时停止，返回最近的路段和查询点在其上的投影。
+class SegmentIndex {
+public:
+    using Index = Graph::Index;
+
+    void build(const Graph& graph);
+    bool empty() const { return segments_.empty(); }
+
+    // 最近路段上的投影位置，跳过代价配置 profile（为空时为默认的驾车配置）不能通行的道路；找不到时返回 false。
+    // 与 findNearestConnectedNode 一样优先吸附到最大连通分量上：只要它不比最近的路段远出 kMainComponentMargin 米，
+    // 就不吸附到孤立的小块路网（停车场、封闭的服务道路等）上
+    static constexpr double kMainComponentMargin = 100;
+    bool nearest(double lat, double lon, RoadPosition& position, const CostProfile* profile = nullptr) const;
+
+    void save(SnapshotWriter& writer) const;
+    bool load(const SnapshotReader& reader);
+
+private:
+    // 路段上的一段直线：路段从 a 到 b，正反方向的边为 forward / backward，道路等级为 road_class，
+    // modes 为两个方向允许的出行方式之并，main 表示路段在最大连通分量里，
+    // 这段直线覆盖路段长度比例的 [t0, t1]
+    struct Segment {
+        Index a, b;
+        uint32_t forward, backward;
+        uint8_t road_class;
+        uint8_t modes;
+        uint8_t main;
+        uint8_t reserved;
+        float t0, t1;
+        float ax, ay, bx, by;
+    };
+    struct Grid {
+        double origin_lat, origin_lon;   // 投影原点：所有顶点与形状点包围盒的西南角
+        double meters_per_lat, meters_per_lon;
+        double cell_size;                // 米
+        uint32_t columns, rows;
+    };
+
+    Grid grid_{};
+    Column<Segment> segments_;
+    // 单元 (col, row) 中的路段为 cell_segments_[cell_offsets_[c]..cell_offsets_[c + 1])，c = row * columns + col
+    Column<uint32_t> cell_offsets_;
+    Column<uint32_t> cell_segments_;
+};
+
+inline SegmentIndex road_segments;
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+// 二进制图快照：离线把解析结果写成带版本号的分段文件，启动时 mmap 读取
+//
+// 文件布局：
+//   Header { magic, version, section_count }
+//   SectionEntry[section_count] { tag, elem_size, offset, count }
+//   各段数据（按 64 字节对齐，可直接当作数组使用）
+
+constexpr uint32_t kSnapshotMagic = 0x47534F4D; // "MOSG"
+constexpr uint32_t kSnapshotVersion = 19;
+
+constexpr uint32_t sectionTag(const char (&name)[5]) {
+    return uint32_t(uint8_t(name[0])) | uint32_t(uint8_t(name[1])) << 8 |
+           uint32_t(uint8_t(name[2])) << 16 | uint32_t(uint8_t(name[3])) << 24;
+}
+
+// 只读内存映射文件
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+class SnapshotWriter {
+public:
+    template <typename T>
+    void add(uint32_t tag, const T* data, size_t count) {
+        static_assert(std::is_trivially_copyable<T>::value, "snapshot sections must be POD arrays");
+        Section s{tag, uint32_t(sizeof(T)), count, {}};
+        s.bytes.resize(sizeof(T) * count);
+        if (count) memcpy(s.bytes.data(), data, s.bytes.size());
+        sections_.push_back(std::move(s));
+    }
+
+    template <typename T>
+    void add(uint32_t tag, const std::vector<T>& values) {
+        add(tag, values.data(), values.size());
+    }
+
+    bool write(const std::string& path) const;
+
+private:
+    struct Section {
+        uint32_t tag;
+        uint32_t elem_size;
+        uint64_t count;
+        std::vector<char> bytes;
+    };
+    std::vector<Section> sections_;
+};
+
+class SnapshotReader {
+public:
+    // 映射并校验文件头；版本不符时返回 false
+    bool open(const std::string& path);
+
+    // 取出一个段；段不存在或元素大小不符时返回 nullptr
+    template <typename T>
+    const T* get(uint32_t tag, size_t& count) const {
+        const char* p = find(tag, sizeof(T), count);
+        return reinterpret_cast<const T*>(p);
+    }
+
+private:
+    MappedFile file_;
+
+    const char* find(uint32_t tag, uint32_t elem_size, size_t& count) const;
+};
+
+// 把当前全局图数据写成快照 / 从快照恢复全局图数据
+bool saveGraphSnapshot(const std::string& path);
+bool loadGraphSnapshot(const std::string& path);
@@ -0,0 +1,159 @@
+#pragma once
+#include "graph.hpp"
+
+// 点空间索引：把坐标吸附到最近的路网节点，以及 k 近邻 / 半径查询。
+// 索引中是道路上的全部节点，即图的顶点加上压缩进路段的形状点。
+// 有 K-d 树和均匀网格两种实现，启动时选择其一（--spatial-index kdtree|grid）；
+// 两者都一次性批量构建、以扁平数组存放，并可直接写入快照再映射回来。
+
+struct Neighbor {
+    long long id;
+    double meters;
+    double lat, lon;
+};
+
+// 以调用方提供的数组为存储的有界大顶堆，保留 key 最小的至多 capacity 项。
+// 搜索过程中 id 暂存实现内部的点下标，finish() 之后按 key 升序排列
+class NeighborHeap {
+public:
+    NeighborHeap(Neighbor* out, size_t capacity, double max_key)
+        : out_(out), capacity_(capacity), max_key_(max_key) {}
+
+    // 新的点只有 key 不超过该值才可能入选，可用于剪枝
+    double limit() const { return count_ < capacity_ ? max_key_ : out_[0].meters; }
+
+    void offer(long long index, double key) {
+        if (count_ < capacity_) {
+            if (key > max_key_) return;
+            out_[count_++] = {index, key, 0, 0};
+            std::push_heap(out_, out_ + count_, farther);
+        } else if (capacity_ > 0 && key < out_[0].meters) {
+            std::pop_heap(out_, out_ + count_, farther);
+            out_[count_ - 1] = {index, key, 0, 0};
+            std::push_heap(out_, out_ + count_, farther);
+        }
+    }
+
+    Neighbor* data() const { return out_; }
+
+    size_t finish() {
+        std::sort_heap(out_, out_ + count_, farther);
+        return count_;
+    }
+
+private:
+    static bool farther(const Neighbor& a, const Neighbor& b) { return a.meters < b.meters; }
+
+    Neighbor* out_;
+    size_t capacity_;
+    size_t count_ = 0;
+    double max_key_;
+};
+
+class SpatialIndex {
+public:
+    virtual ~SpatialIndex() = default;
+
+    virtual const char* name() const = 0;
+    // 用图中全部顶点和形状点重建索引；查询结果中的 id 为节点的 OSM ID
+    virtual void build(const Graph& graph) = 0;
+    virtual bool empty() const = 0;
+
+    // 最近的 k 个点，按距离升序写入 out（至少能放下 k 个），返回实际个数；不做任何分配
+    virtual size_t nearest(double lat, double lon, size_t k, Neighbor* out) const = 0;
+    // 距离不超过 meters 的点中最近的至多 capacity 个，按距离升序写入 out，返回实际个数
+    virtual size_t withinRadius(double lat, double lon, double meters, Neighbor* out, size_t capacity) const = 0;
+
+    // meters 非空时返回到最近点的球面距离；索引为空时返回 0
+    long long findNearestNode(double lat, double lon, double* meters = nullptr) const {
+        Neighbor best;
+        if (nearest(lat, lon, 1, &best) == 0) return 0;
+        if (meters) *meters = best.meters;
+        return best.id;
+    }
+
+    virtual void save(SnapshotWriter& writer) const = 0;
+    virtual bool load(const SnapshotReader& reader) = 0;
+};
+
+// 静态 K-d 树：一次性批量构建，按中位数划分，隐式存放在一个数组里。
+// 区间 [lo, hi) 的根是中点 mid = (lo + hi) / 2，左右子树分别是 [lo, mid) 和 [mid + 1, hi)，
+// 不需要子节点指针，深度恒为 O(log n)。
+//
+// 点存为单位球面上的三维坐标：弦长与球面距离单调对应，因此按弦长找到的最近点就是球面上的最近点，
+// 而坐标差又是弦长的下界，用来剪枝是精确的。只对最终结果用 Haversine 计算实际距离。
+class KDTree : public SpatialIndex {
+public:
+    struct Point {
+        double x, y, z;
+        double lat, lon;
+        long long id;
+        uint32_t axis;  // 以该点为根的子树按哪一维划分，构建时确定
+        uint32_t reserved;
+
+        static Point fromLatLon(double lat, double lon, long long id);
+    };
+
+    const char* name() const override { return "kdtree"; }
+    void build(const Graph& graph) override;
+    bool empty() const override { return points_.empty(); }
+
+    size_t nearest(double lat, double lon, size_t k, Neighbor* out) const override;
+    size_t withinRadius(double lat, double lon, double meters, Neighbor* out, size_t capacity) const override;
+
+    void save(SnapshotWriter& writer) const override;
+    bool load(const SnapshotReader& reader) override;
+
+private:
+    Column<Point> points_;
+
+    // 按弦长平方收集，结果换算为球面距离
+    size_t search(double lat, double lon, NeighborHeap& heap) const;
+};
+
+// 均匀网格：点按局部等距圆柱投影换算成平面米坐标，按所在单元排序后连续存放，
+// 每个单元对应其中的一段。查询从查询点所在单元一圈圈向外扫描，
+// 当下一圈离查询点的最近距离已不小于当前第 k 近的距离时停止。
+// 城市范围内投影与球面距离的差别远小于 1 米，最终结果同样用 Haversine 给出距离。
+class GridIndex : public SpatialIndex {
+public:
+    const char* name() const override { return "grid"; }
+    void build(const Graph& graph) override;
+    bool empty() const override { return entries_.empty(); }
+
+    size_t nearest(double lat, double lon, size_t k, Neighbor* out) const override;
+    size_t withinRadius(double lat, double lon, double meters, Neighbor* out, size_t capacity) const override;
+
+    void save(SnapshotWriter& writer) const override;
+    bool load(const SnapshotReader& reader) override;
+
+private:
+    struct Entry {
+        float x, y;   // 投影坐标（米）
+        long long id;
+        double lat, lon;
+    };
+    struct Grid {
+        double origin_lat, origin_lon;   // 投影原点：所有点包围盒的西南角
+        double meters_per_lat, meters_per_lon;
+        double cell_size;                // 米
+        uint32_t columns, rows;
+    };
+
+    Grid grid_{};
+    // 单元 c = row * columns + col 中的点为 entries_[cell_offsets_[c]..cell_offsets_[c + 1])
+    Column<uint32_t> cell_offsets_;
+    Column<Entry> entries_;
+
+    // 按投影距离的平方收集，结果换算为球面距离
+    size_t search(double lat, double lon, NeighborHeap& heap) const;
+};
+
+inline KDTree kdtree;
+inline GridIndex grid_index;
+// 服务查询所用的索引，启动时选择
+inline SpatialIndex* spatial_index = &kdtree;
+
+long long findNearestNode(double targetLat, double targetLon);
+// 最近的图顶点（跳过形状点），在附近几个候选中优先选择最大连通分量里的顶点；没有顶点时返回 0
+long long findNearestConnectedNode(double targetLat, double targetLon);
@@ -0,0 +1,52 @@
+#pragma once
+#include <string_view>
+#include "graph.hpp"
+
+// 道路属性表：每条道路只存一条定长记录，名称和道路类型驻留在共享的字符串池里，
+// 记录中只保存字符串编号。图的每条边记下所属道路的下标（Graph::edgeWay），
+// 查询限速、名称等属性就是两次数组访问
+class WayTable {
+public:
+    static constexpr uint32_t kNoWay = std::numeric_limits<uint32_t>::max();
+
+    struct Record {
+        long long id;
+        double speed_limit;   // km/h
+        uint32_t highway;     // 字符串编号
+        uint32_t name;
+        uint8_t forward_modes;    // 沿节点顺序 / 逆向允许的出行方式（TravelMode 按位组合）
+        uint8_t backward_modes;
+        uint8_t padding[6];
+    };
+
+    // 构建阶段：追加一条道路，返回其下标；全部加入后调用 freeze()
+    uint32_t add(long long id, WayAccess access, double speed_limit, const std::string& highway, const std::string& name);
+    void freeze();
+
+    size_t size() const { return records_.size(); }
+    const Record& operator[](uint32_t w) const { return records_[w]; }
+    std::string_view text(uint32_t s) const {
+        return std::string_view(chars_.data() + string_offsets_[s], string_offsets_[s + 1] - string_offsets_[s]);
+    }
+    std::string_view highway(uint32_t w) const { return text(records_[w].highway); }
+    std::string_view name(uint32_t w) const { return text(records_[w].name); }
+
+    void save(SnapshotWriter& writer) const;
+    bool load(const SnapshotReader& reader);
+
+private:
+    // 构建阶段的数据，freeze() 后转入下面的列
+    std::vector<Record> pending_records_;
+    std::vector<uint32_t> pending_offsets_{0};
+    std::vector<char> pending_chars_;
+    std::unordered_map<std::string, uint32_t> interned_;
+
+    Column<Record> records_;
+    // 字符串 s 为 chars_[string_offsets_[s]..string_offsets_[s + 1])
+    Column<uint32_t> string_offsets_;
+    Column<char> chars_;
+
+    uint32_t intern(const std::string& s);
+};
+
+inline WayTable way_table;
@@ -0,0 +1,87 @@
+#include "matrix.hpp"
+#include "ch.hpp"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+using Index = Graph::Index;
+
+struct BucketEntry {
+    Index vertex;
+    uint32_t target;
+    double weight;
+    double length;
+};
+
+// 有线程池时与池中的线程一起领取下标，否则在调用线程上依次执行
+template <typename Task>
+void forEach(size_t count, TaskPool* pool, Task task) {
+    if (pool) parallelFor(count, *pool, task);
+    else for (size_t i = 0; i < count; ++i) task(i);
+}
+
+void bucketMatrix(const vector<Endpoint>& sources, const vector<Endpoint>& targets,
+                  TaskPool* pool, TravelMatrix& matrix) {
+    // 反向阶段：每个目标的上行搜索空间各自收集，再按顶点排序拼成桶
+    vector<vector<BucketEntry>> per_target(targets.size());
+    forEach(targets.size(), pool, [&](size_t j) {
+        if (targets[j].count == 0) return;
+        hierarchy.upwardSearch(graph, targets[j], false, [&](Index v, double weight, double length) {
+            per_target[j].push_back({v, uint32_t(j), weight, length});
+        });
+    });
+    vector<BucketEntry> buckets;
+    for (auto& entries : per_target) {
+        buckets.insert(buckets.end(), entries.begin(), entries.end());
+        entries = vector<BucketEntry>();
+    }
+    sort(buckets.begin(), buckets.end(),
+         [](const BucketEntry& a, const BucketEntry& b) { return a.vertex < b.vertex; });
+
+    // 正向阶段：源的每个结算顶点与桶中记录相加，取最小值
+    forEach(sources.size(), pool, [&](size_t i) {
+        if (sources[i].count == 0) return;
+        double* weights = &matrix.weights[i * matrix.cols];
+        double* lengths = &matrix.lengths[i * matrix.cols];
+        hierarchy.upwardSearch(graph, sources[i], true, [&](Index v, double weight, double length) {
+            auto it = lower_bound(buckets.begin(), buckets.end(), v,
+                                  [](const BucketEntry& entry, Index key) { return entry.vertex < key; });
+            for (; it != buckets.end() && it->vertex == v; ++it) {
+                double total = weight + it->weight;
+                if (total < weights[it->target]) {
+                    weights[it->target] = total;
+                    lengths[it->target] = length + it->length;
+                }
+            }
+        });
+    });
+}
+
+} // namespace
+
+TravelMatrix computeTravelMatrix(const vector<Endpoint>& sources, const vector<Endpoint>& targets, TaskPool* pool,
+                                 const CostProfile* profile) {
+    TravelMatrix matrix;
+    matrix.rows = sources.size();
+    matrix.cols = targets.size();
+    matrix.weights.assign(matrix.rows * matrix.cols, SearchSpace::kInfinity);
+    matrix.lengths.assign(matrix.rows * matrix.cols, SearchSpace::kInfinity);
+    matrix.seconds.assign(matrix.rows * matrix.cols, SearchSpace::kInfinity);
+    if (matrix.rows == 0 || matrix.cols == 0) return matrix;
+
+    if (!hierarchy.empty() && !profile) {
+        bucketMatrix(sources, targets, pool, matrix);
+        // 默认配置的边权就是按默认速度算出的时间
+        for (size_t i = 0; i < matrix.weights.size(); ++i) {
+            if (matrix.weights[i] != SearchSpace::kInfinity) matrix.seconds[i] = matrix.weights[i] * kSecondsPerWeightUnit;
+        }
+        return matrix;
+    }
+    forEach(sources.size(), pool, [&](size_t i) {
+        graph.oneToMany(sources[i], targets, &matrix.weights[i * matrix.cols], &matrix.lengths[i * matrix.cols],
+                        &matrix.seconds[i * matrix.cols], profile);
+    });
+    return matrix;
+}
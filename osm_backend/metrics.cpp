@@ -0,0 +1,172 @@
+#include "metrics.hpp"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+// 后台线程汇总记录的间隔
+const auto kFlushInterval = chrono::milliseconds(200);
+
+void renderHistogram(ostringstream& out, const char* name, const char* algorithm, const LatencyHistogram& histogram) {
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < LatencyHistogram::kBucketCount; ++i) {
+        cumulative += histogram.buckets[i];
+        out << name << "_bucket{algorithm=\"" << algorithm << "\",le=\"" << LatencyHistogram::kBounds[i] << "\"} "
+            << cumulative << "\n";
+    }
+    cumulative += histogram.buckets[LatencyHistogram::kBucketCount];
+    out << name << "_bucket{algorithm=\"" << algorithm << "\",le=\"+Inf\"} " << cumulative << "\n";
+    out << name << "_sum{algorithm=\"" << algorithm << "\"} " << histogram.sum << "\n";
+    out << name << "_count{algorithm=\"" << algorithm << "\"} " << histogram.count << "\n";
+}
+
+} // namespace
+
+const char* algorithmName(Algorithm algorithm) {
+    switch (algorithm) {
+        case Algorithm::Dijkstra: return "dijkstra";
+        case Algorithm::AStar: return "a-star";
+        case Algorithm::Bidirectional: return "bidirectional";
+        case Algorithm::Alt: return "alt";
+        case Algorithm::Ch: return "ch";
+        case Algorithm::TurnAware: return "turn-aware";
+        case Algorithm::Matrix: return "matrix";
+        default: return "unknown";
+    }
+}
+
+RecordRing::RecordRing(size_t capacity) : slots_(new Slot[capacity]), mask_(capacity - 1) {
+    for (size_t i = 0; i < capacity; ++i) slots_[i].sequence.store(i, memory_order_relaxed);
+}
+
+bool RecordRing::push(const RequestRecord& record) {
+    size_t pos = head_.load(memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots_[pos & mask_];
+        size_t sequence = slot->sequence.load(memory_order_acquire);
+        intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+        if (diff == 0) {
+            if (head_.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            return false;  // 消费者还没取走这一圈的记录，缓冲区已满
+        } else {
+            pos = head_.load(memory_order_relaxed);
+        }
+    }
+    slot->record = record;
+    slot->sequence.store(pos + 1, memory_order_release);
+    return true;
+}
+
+bool RecordRing::pop(RequestRecord& record) {
+    Slot& slot = slots_[tail_ & mask_];
+    if (slot.sequence.load(memory_order_acquire) != tail_ + 1) return false;
+    record = slot.record;
+    slot.sequence.store(tail_ + mask_ + 1, memory_order_release);
+    ++tail_;
+    return true;
+}
+
+void LatencyHistogram::observe(double value) {
+    size_t i = 0;
+    while (i < kBucketCount && value > kBounds[i]) ++i;
+    ++buckets[i];
+    ++count;
+    sum += value;
+}
+
+Metrics::Metrics() : ring_(kRingCapacity) {}
+
+void Metrics::start(bool log_requests) {
+    lock_guard<mutex> lock(wake_mutex_);
+    if (running_) return;
+    running_ = true;
+    log_requests_ = log_requests;
+    flusher_ = thread(&Metrics::run, this);
+}
+
+void Metrics::stop() {
+    {
+        lock_guard<mutex> lock(wake_mutex_);
+        if (!running_) return;
+        running_ = false;
+    }
+    wake_.notify_all();
+    flusher_.join();
+    drain();
+}
+
+void Metrics::record(const RequestRecord& record) {
+    if (!ring_.push(record)) dropped_.fetch_add(1, memory_order_relaxed);
+}
+
+void Metrics::run() {
+    unique_lock<mutex> lock(wake_mutex_);
+    while (running_) {
+        wake_.wait_for(lock, kFlushInterval, [this] { return !running_; });
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
+
+// 取出缓冲区里的全部记录并汇总；请求日志攒成一块一次写出
+void Metrics::drain() {
+    RequestRecord record;
+    string log;
+    lock_guard<mutex> lock(totals_mutex_);
+    while (ring_.pop(record)) {
+        Totals& totals = totals_[size_t(record.algorithm)];
+        ++totals.requests;
+        if (!record.found) ++totals.not_found;
+        totals.settled += record.settled;
+        totals.path_nodes += record.path_nodes;
+        totals.path_meters += record.path_meters;
+        totals.snap_ms.observe(record.snap_ms);
+        totals.search_ms.observe(record.search_ms);
+        if (log_requests_) {
+            char line[160];
+            snprintf(line, sizeof(line), "%s found=%d settled=%u nodes=%u meters=%.1f snap_ms=%.3f search_ms=%.3f\n",
+                     algorithmName(record.algorithm), record.found ? 1 : 0, record.settled, record.path_nodes,
+                     record.path_meters, record.snap_ms, record.search_ms);
+            log += line;
+        }
+    }
+    if (!log.empty()) cout << log << flush;
+}
+
+string Metrics::render() {
+    ostringstream out;
+    lock_guard<mutex> lock(totals_mutex_);
+    auto counter = [&](const char* name, auto value) {
+        out << "# TYPE " << name << " counter\n";
+        for (size_t a = 0; a < size_t(Algorithm::Count); ++a) {
+            out << name << "{algorithm=\"" << algorithmName(Algorithm(a)) << "\"} " << value(totals_[a]) << "\n";
+        }
+    };
+    counter("osm_requests_total", [](const Totals& t) { return t.requests; });
+    counter("osm_routes_not_found_total", [](const Totals& t) { return t.not_found; });
+    counter("osm_settled_nodes_total", [](const Totals& t) { return t.settled; });
+    counter("osm_path_nodes_total", [](const Totals& t) { return t.path_nodes; });
+    counter("osm_path_meters_total", [](const Totals& t) { return t.path_meters; });
+
+    out << "# TYPE osm_snap_milliseconds histogram\n";
+    for (size_t a = 0; a < size_t(Algorithm::Count); ++a) {
+        renderHistogram(out, "osm_snap_milliseconds", algorithmName(Algorithm(a)), totals_[a].snap_ms);
+    }
+    out << "# TYPE osm_search_milliseconds histogram\n";
+    for (size_t a = 0; a < size_t(Algorithm::Count); ++a) {
+        renderHistogram(out, "osm_search_milliseconds", algorithmName(Algorithm(a)), totals_[a].search_ms);
+    }
+
+    out << "# TYPE osm_bad_requests_total counter\n";
+    out << "osm_bad_requests_total " << errors_.load(memory_order_relaxed) << "\n";
+    out << "# TYPE osm_metrics_dropped_total counter\n";
+    out << "osm_metrics_dropped_total " << dropped_.load(memory_order_relaxed) << "\n";
+    return out.str();
+}
@@ -0,0 +1,399 @@
+#include "osm_reader.hpp"
+#include "parallel.hpp"
+#include "snapshot.hpp"
+#include <cstring>
+#include <iostream>
+#include <zlib.h>
+
+using namespace std;
+
+// OSM PBF 格式：文件由若干 [4 字节大端长度][BlobHeader][Blob] 组成。
+// 第一个块是 OSMHeader，其余是 OSMData（PrimitiveBlock）。消息按 protobuf 编码，这里手写解码，
+// 只读取建图需要的字段：节点（含 DenseNodes）的 ID 与坐标，道路的 ID、标签和节点引用，关系的 ID、标签和成员
+
+namespace {
+
+// 一次并行解码的块数上限（乘以线程数），限制同时缓存的元素数量
+const size_t kBlocksPerThread = 8;
+// 单个块解压后的大小上限（格式规定为 32MB）
+const size_t kMaxBlobSize = 32 << 20;
+
+// protobuf 线格式读取器；越界或格式错误时置 failed，之后读到的都是 0
+class ProtoReader {
+public:
+    enum WireType { kVarint = 0, kFixed64 = 1, kLengthDelimited = 2, kFixed32 = 5 };
+
+    ProtoReader() = default;
+    ProtoReader(const uint8_t* data, size_t size) : p_(data), end_(data + size) {}
+
+    bool failed() const { return failed_; }
+    bool atEnd() const { return p_ >= end_; }
+
+    // 读取下一个字段头；没有更多字段时返回 false
+    bool next() {
+        if (failed_ || p_ >= end_) return false;
+        uint64_t key = varint();
+        field_ = uint32_t(key >> 3);
+        wire_ = uint32_t(key & 7);
+        return !failed_;
+    }
+    uint32_t field() const { return field_; }
+    uint32_t wire() const { return wire_; }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p_ >= end_) return fail();
+            uint8_t byte = *p_++;
+            value |= uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        return fail();
+    }
+    int64_t svarint() {
+        uint64_t v = varint();
+        return int64_t(v >> 1) ^ -int64_t(v & 1);
+    }
+    // 长度前缀的字段：字符串、嵌套消息或打包的重复字段
+    ProtoReader message() {
+        uint64_t size = varint();
+        if (failed_ || size > uint64_t(end_ - p_)) {
+            fail();
+            return ProtoReader();
+        }
+        ProtoReader sub(p_, size_t(size));
+        p_ += size;
+        return sub;
+    }
+    // 打包的重复字段：逐个调用 read(values) 读取其中的元素
+    template <typename Read>
+    void packed(Read read) {
+        ProtoReader values = message();
+        while (!values.atEnd() && !values.failed()) read(values);
+        if (values.failed()) fail();
+    }
+    string text() {
+        ProtoReader sub = message();
+        return string(reinterpret_cast<const char*>(sub.p_), sub.end_ - sub.p_);
+    }
+    const uint8_t* data() const { return p_; }
+    size_t size() const { return end_ - p_; }
+
+    void skip() {
+        switch (wire_) {
+        case kVarint: varint(); break;
+        case kFixed64: advance(8); break;
+        case kLengthDelimited: message(); break;
+        case kFixed32: advance(4); break;
+        default: fail();
+        }
+    }
+
+private:
+    const uint8_t* p_ = nullptr;
+    const uint8_t* end_ = nullptr;
+    uint32_t field_ = 0, wire_ = 0;
+    bool failed_ = false;
+
+    uint64_t fail() {
+        failed_ = true;
+        p_ = end_;
+        return 0;
+    }
+    void advance(size_t n) {
+        if (size_t(end_ - p_) < n) fail();
+        else p_ += n;
+    }
+};
+
+struct BlobLocation {
+    string type;          // "OSMHeader" 或 "OSMData"
+    const uint8_t* data;  // Blob 消息
+    size_t size;
+};
+
+uint32_t readBigEndian32(const uint8_t* p) {
+    return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | uint32_t(p[3]);
+}
+
+// 扫描整个文件，只解析 BlobHeader 得到每个块的位置
+bool scanBlobs(const uint8_t* p, const uint8_t* end, vector<BlobLocation>& blobs) {
+    while (p < end) {
+        if (end - p < 4) return false;
+        uint32_t header_size = readBigEndian32(p);
+        p += 4;
+        if (uint32_t(end - p) < header_size) return false;
+        ProtoReader header(p, header_size);
+        p += header_size;
+        BlobLocation blob{"", nullptr, 0};
+        uint64_t data_size = 0;
+        while (header.next()) {
+            if (header.field() == 1 && header.wire() == ProtoReader::kLengthDelimited) blob.type = header.text();
+            else if (header.field() == 3 && header.wire() == ProtoReader::kVarint) data_size = header.varint();
+            else header.skip();
+        }
+        if (header.failed() || data_size > uint64_t(end - p)) return false;
+        blob.data = p;
+        blob.size = size_t(data_size);
+        p += data_size;
+        blobs.push_back(std::move(blob));
+    }
+    return true;
+}
+
+// 取出 Blob 中的原始数据；zlib 压缩的解压到 buffer
+bool unpackBlob(const BlobLocation& location, vector<uint8_t>& buffer, ProtoReader& out) {
+    ProtoReader blob(location.data, location.size);
+    uint64_t raw_size = 0;
+    ProtoReader raw, compressed;
+    bool has_raw = false, has_zlib = false;
+    while (blob.next()) {
+        if (blob.field() == 1 && blob.wire() == ProtoReader::kLengthDelimited) {
+            raw = blob.message();
+            has_raw = true;
+        } else if (blob.field() == 2 && blob.wire() == ProtoReader::kVarint) {
+            raw_size = blob.varint();
+        } else if (blob.field() == 3 && blob.wire() == ProtoReader::kLengthDelimited) {
+            compressed = blob.message();
+            has_zlib = true;
+        } else if (blob.field() >= 4 && blob.field() <= 7) {
+            cerr << "Unsupported PBF blob compression (field " << blob.field() << ")" << endl;
+            return false;
+        } else {
+            blob.skip();
+        }
+    }
+    if (blob.failed()) return false;
+    if (has_raw) {
+        out = raw;
+        return true;
+    }
+    if (!has_zlib || raw_size > kMaxBlobSize) return false;
+    buffer.resize(size_t(raw_size));
+    uLongf length = uLongf(raw_size);
+    if (uncompress(buffer.data(), &length, compressed.data(), uLong(compressed.size())) != Z_OK || length != raw_size) {
+        return false;
+    }
+    out = ProtoReader(buffer.data(), buffer.size());
+    return true;
+}
+
+// OSMHeader 中列出的必需特性都要支持
+bool checkHeader(ProtoReader header) {
+    while (header.next()) {
+        if (header.field() == 4 && header.wire() == ProtoReader::kLengthDelimited) {
+            string feature = header.text();
+            if (feature != "OsmSchema-V0.6" && feature != "DenseNodes") {
+                cerr << "Unsupported PBF feature " << feature << endl;
+                return false;
+            }
+        } else {
+            header.skip();
+        }
+    }
+    return !header.failed();
+}
+
+struct BlockContext {
+    vector<string> strings;
+    int64_t granularity = 100;
+    int64_t lat_offset = 0, lon_offset = 0;
+
+    double lat(int64_t value) const { return 1e-9 * double(lat_offset + granularity * value); }
+    double lon(int64_t value) const { return 1e-9 * double(lon_offset + granularity * value); }
+    const string& text(uint64_t index) const {
+        static const string empty;
+        return index < strings.size() ? strings[index] : empty;
+    }
+};
+
+bool decodeNode(ProtoReader node, const BlockContext& context, OsmHandler& handler) {
+    int64_t id = 0, lat = 0, lon = 0;
+    while (node.next()) {
+        if (node.field() == 1 && node.wire() == ProtoReader::kVarint) id = node.svarint();
+        else if (node.field() == 8 && node.wire() == ProtoReader::kVarint) lat = node.svarint();
+        else if (node.field() == 9 && node.wire() == ProtoReader::kVarint) lon = node.svarint();
+        else node.skip();
+    }
+    if (node.failed()) return false;
+    handler.node(id, context.lat(lat), context.lon(lon));
+    return true;
+}
+
+// DenseNodes：ID 与坐标分别打包，按差分编码
+bool decodeDenseNodes(ProtoReader dense, const BlockContext& context, OsmHandler& handler) {
+    vector<int64_t> ids, lats, lons;
+    auto readDeltas = [&dense](vector<int64_t>& values) {
+        int64_t last = 0;
+        dense.packed([&](ProtoReader& packed) {
+            last += packed.svarint();
+            values.push_back(last);
+        });
+    };
+    while (dense.next()) {
+        if (dense.wire() != ProtoReader::kLengthDelimited) dense.skip();
+        else if (dense.field() == 1) readDeltas(ids);
+        else if (dense.field() == 8) readDeltas(lats);
+        else if (dense.field() == 9) readDeltas(lons);
+        else dense.skip();
+    }
+    if (dense.failed() || lats.size() != ids.size() || lons.size() != ids.size()) return false;
+    for (size_t i = 0; i < ids.size(); ++i) handler.node(ids[i], context.lat(lats[i]), context.lon(lons[i]));
+    return true;
+}
+
+bool decodeWay(ProtoReader message, const BlockContext& context, OsmWay& way, OsmHandler& handler) {
+    way.id = 0;
+    way.node_refs.clear();
+    way.tags.clear();
+    vector<uint64_t> keys, values;
+    while (message.next()) {
+        if (message.field() == 1 && message.wire() == ProtoReader::kVarint) {
+            way.id = int64_t(message.varint());
+        } else if (message.wire() != ProtoReader::kLengthDelimited) {
+            message.skip();
+        } else if (message.field() == 2) {
+            message.packed([&](ProtoReader& packed) { keys.push_back(packed.varint()); });
+        } else if (message.field() == 3) {
+            message.packed([&](ProtoReader& packed) { values.push_back(packed.varint()); });
+        } else if (message.field() == 8) {
+            int64_t last = 0;
+            message.packed([&](ProtoReader& packed) {
+                last += packed.svarint();
+                way.node_refs.push_back(last);
+            });
+        } else {
+            message.skip();
+        }
+    }
+    if (message.failed() || keys.size() != values.size()) return false;
+    for (size_t i = 0; i < keys.size(); ++i) way.tags.emplace_back(context.text(keys[i]), context.text(values[i]));
+    handler.way(way);
+    return true;
+}
+
+bool decodeRelation(ProtoReader message, const BlockContext& context, OsmRelation& relation, OsmHandler& handler) {
+    relation.id = 0;
+    relation.members.clear();
+    relation.tags.clear();
+    vector<uint64_t> keys, values, roles, types;
+    vector<int64_t> refs;
+    while (message.next()) {
+        if (message.field() == 1 && message.wire() == ProtoReader::kVarint) {
+            relation.id = int64_t(message.varint());
+        } else if (message.wire() != ProtoReader::kLengthDelimited) {
+            message.skip();
+        } else if (message.field() == 2) {
+            message.packed([&](ProtoReader& packed) { keys.push_back(packed.varint()); });
+        } else if (message.field() == 3) {
+            message.packed([&](ProtoReader& packed) { values.push_back(packed.varint()); });
+        } else if (message.field() == 8) {
+            message.packed([&](ProtoReader& packed) { roles.push_back(packed.varint()); });
+        } else if (message.field() == 9) {
+            int64_t last = 0;
+            message.packed([&](ProtoReader& packed) {
+                last += packed.svarint();
+                refs.push_back(last);
+            });
+        } else if (message.field() == 10) {
+            message.packed([&](ProtoReader& packed) { types.push_back(packed.varint()); });
+        } else {
+            message.skip();
+        }
+    }
+    if (message.failed() || keys.size() != values.size() || roles.size() != refs.size() || types.size() != refs.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < keys.size(); ++i) relation.tags.emplace_back(context.text(keys[i]), context.text(values[i]));
+    for (size_t i = 0; i < refs.size(); ++i) {
+        // MemberType：0 节点，1 道路，2 关系
+        OsmMember::Type type = types[i] == 0 ? OsmMember::kNode : types[i] == 1 ? OsmMember::kWay : OsmMember::kRelation;
+        relation.members.push_back({type, refs[i], context.text(roles[i])});
+    }
+    handler.relation(relation);
+    return true;
+}
+
+bool decodePrimitiveBlock(ProtoReader block, OsmHandler& handler) {
+    // 字符串表和坐标参数可能出现在各个 PrimitiveGroup 之后，先读完它们
+    BlockContext context;
+    vector<ProtoReader> groups;
+    while (block.next()) {
+        if (block.field() == 1 && block.wire() == ProtoReader::kLengthDelimited) {
+            ProtoReader table = block.message();
+            while (table.next()) {
+                if (table.field() == 1 && table.wire() == ProtoReader::kLengthDelimited) context.strings.push_back(table.text());
+                else table.skip();
+            }
+            if (table.failed()) return false;
+        } else if (block.field() == 2 && block.wire() == ProtoReader::kLengthDelimited) {
+            groups.push_back(block.message());
+        } else if (block.field() == 17 && block.wire() == ProtoReader::kVarint) {
+            context.granularity = int64_t(block.varint());
+        } else if (block.field() == 19 && block.wire() == ProtoReader::kVarint) {
+            context.lat_offset = int64_t(block.varint());
+        } else if (block.field() == 20 && block.wire() == ProtoReader::kVarint) {
+            context.lon_offset = int64_t(block.varint());
+        } else {
+            block.skip();
+        }
+    }
+    if (block.failed()) return false;
+
+    OsmWay way;
+    OsmRelation relation;
+    for (ProtoReader& group : groups) {
+        while (group.next()) {
+            bool ok = true;
+            if (group.wire() != ProtoReader::kLengthDelimited) group.skip();
+            else if (group.field() == 1) ok = decodeNode(group.message(), context, handler);
+            else if (group.field() == 2) ok = decodeDenseNodes(group.message(), context, handler);
+            else if (group.field() == 3) ok = decodeWay(group.message(), context, way, handler);
+            else if (group.field() == 4) ok = decodeRelation(group.message(), context, relation, handler);
+            else group.skip();
+            if (!ok) return false;
+        }
+        if (group.failed()) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool readOsmPbf(const string& path, OsmHandler& handler, unsigned threads) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(file.data());
+    vector<BlobLocation> blobs;
+    if (!scanBlobs(begin, begin + file.size(), blobs)) {
+        cerr << "Corrupt PBF block header in " << path << endl;
+        return false;
+    }
+
+    if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+    // 分批并行解码，每批解码完按顺序交给处理器后释放
+    size_t batch = size_t(threads) * kBlocksPerThread;
+    for (size_t first = 0; first < blobs.size(); first += batch) {
+        size_t count = min(batch, blobs.size() - first);
+        vector<BufferedOsmHandler> results(count);
+        vector<char> decoded(count, 0);
+        parallelFor(count, threads, [&](size_t i) {
+            const BlobLocation& location = blobs[first + i];
+            vector<uint8_t> buffer;
+            ProtoReader content;
+            if (!unpackBlob(location, buffer, content)) return;
+            if (location.type == "OSMHeader") decoded[i] = checkHeader(content);
+            else if (location.type == "OSMData") decoded[i] = decodePrimitiveBlock(content, results[i]);
+            else decoded[i] = 1;  // 未知类型的块按规范跳过
+        });
+        for (size_t i = 0; i < count; ++i) {
+            if (!decoded[i]) {
+                cerr << "Failed to decode PBF block " << first + i << " of " << path << endl;
+                return false;
+            }
+            results[i].replay(handler);
+            results[i] = BufferedOsmHandler();
+        }
+    }
+    return true;
+}
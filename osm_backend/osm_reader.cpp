@@ -0,0 +1,352 @@
+#include "osm_reader.hpp"
+#include "parallel.hpp"
+#include "snapshot.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+// 每批中每个线程平均分到的块数；块多一些可以平衡各块中道路与节点解析代价的差异
+const size_t kChunksPerThread = 4;
+// 小于该大小的文件不切块
+const size_t kMinChunkSize = 1 << 20;
+// 大文件按该大小切块，每批只缓存 线程数 × kChunksPerThread 块解析出的元素，内存峰值与文件大小无关
+const size_t kMaxChunkSize = 16 << 20;
+
+bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool nameIs(const char* b, const char* e, const char* name) {
+    size_t len = strlen(name);
+    return size_t(e - b) == len && memcmp(b, name, len) == 0;
+}
+
+long long parseLongLong(const char* b, const char* e) {
+    bool negative = false;
+    if (b < e && (*b == '-' || *b == '+')) negative = *b++ == '-';
+    long long v = 0;
+    for (; b < e && *b >= '0' && *b <= '9'; ++b) v = v * 10 + (*b - '0');
+    return negative ? -v : v;
+}
+
+double parseDouble(const char* b, const char* /*e*/) {
+    // 属性值后面一定跟着引号，strtod 会在引号处停下
+    return strtod(b, nullptr);
+}
+
+void appendUtf8(string& out, unsigned long cp) {
+    if (cp < 0x80) {
+        out += char(cp);
+    } else if (cp < 0x800) {
+        out += char(0xC0 | (cp >> 6));
+        out += char(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += char(0xE0 | (cp >> 12));
+        out += char(0x80 | ((cp >> 6) & 0x3F));
+        out += char(0x80 | (cp & 0x3F));
+    } else {
+        out += char(0xF0 | (cp >> 18));
+        out += char(0x80 | ((cp >> 12) & 0x3F));
+        out += char(0x80 | ((cp >> 6) & 0x3F));
+        out += char(0x80 | (cp & 0x3F));
+    }
+}
+
+// 解码属性值中的实体引用（&amp; &quot; &#20013; 等）
+string decodeValue(const char* b, const char* e) {
+    string out;
+    out.reserve(e - b);
+    while (b < e) {
+        if (*b != '&') {
+            out += *b++;
+            continue;
+        }
+        const char* semi = static_cast<const char*>(memchr(b, ';', e - b));
+        if (!semi) {
+            out.append(b, e);
+            break;
+        }
+        const char* name = b + 1;
+        if (nameIs(name, semi, "amp")) out += '&';
+        else if (nameIs(name, semi, "lt")) out += '<';
+        else if (nameIs(name, semi, "gt")) out += '>';
+        else if (nameIs(name, semi, "quot")) out += '"';
+        else if (nameIs(name, semi, "apos")) out += '\'';
+        else if (semi - name > 1 && name[0] == '#') {
+            bool hex = name[1] == 'x' || name[1] == 'X';
+            string digits(name + (hex ? 2 : 1), semi);
+            appendUtf8(out, strtoul(digits.c_str(), nullptr, hex ? 16 : 10));
+        } else {
+            out.append(b, semi + 1);
+        }
+        b = semi + 1;
+    }
+    return out;
+}
+
+// 遍历一个开始标签中的属性，回调参数为属性名和（未解码的）属性值
+template <typename F>
+void forEachAttribute(const char* p, const char* e, F&& f) {
+    while (p < e) {
+        while (p < e && isSpace(*p)) ++p;
+        const char* name = p;
+        while (p < e && *p != '=' && !isSpace(*p) && *p != '/') ++p;
+        const char* name_end = p;
+        while (p < e && *p != '=') ++p;
+        if (p >= e) return;
+        ++p;
+        while (p < e && isSpace(*p)) ++p;
+        if (p >= e || (*p != '"' && *p != '\'')) return;
+        char quote = *p++;
+        const char* value = p;
+        while (p < e && *p != quote) ++p;
+        if (p >= e) return;
+        f(name, name_end, value, p);
+        ++p;
+    }
+}
+
+// 在 [p, end) 中查找标签结束的 '>'，跳过引号内的内容
+const char* findTagEnd(const char* p, const char* end) {
+    char quote = 0;
+    for (; p < end; ++p) {
+        if (quote) {
+            if (*p == quote) quote = 0;
+        } else if (*p == '"' || *p == '\'') {
+            quote = *p;
+        } else if (*p == '>') {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+const char* findSequence(const char* p, const char* end, const char* seq) {
+    size_t len = strlen(seq);
+    while (end - p >= ptrdiff_t(len)) {
+        const char* hit = static_cast<const char*>(memchr(p, seq[0], end - p - len + 1));
+        if (!hit) return nullptr;
+        if (memcmp(hit, seq, len) == 0) return hit;
+        p = hit + 1;
+    }
+    return nullptr;
+}
+
+// 逐个标签推进的解析状态机；只要求单个标签完整地位于缓冲区内
+class OsmXmlParser {
+public:
+    explicit OsmXmlParser(OsmHandler& handler) : handler_(handler) {}
+
+    // 解析 [begin, end) 中的完整标签，返回第一个未处理的字节位置
+    const char* feed(const char* begin, const char* end) {
+        const char* p = begin;
+        while (p < end) {
+            const char* lt = static_cast<const char*>(memchr(p, '<', end - p));
+            if (!lt) return end;
+            p = lt;
+            const char* next = consume(p, end);
+            if (!next) return p; // 标签不完整，等待更多数据
+            p = next;
+        }
+        return p;
+    }
+
+private:
+    OsmHandler& handler_;
+    OsmWay way_;
+    OsmRelation relation_;
+    bool in_way_ = false;
+    bool in_relation_ = false;
+    bool in_node_ = false;
+    long long node_id_ = 0;
+    double node_lat_ = 0, node_lon_ = 0;
+
+    const char* consume(const char* p, const char* end) {
+        if (end - p < 2) return nullptr;
+        if (p[1] == '?') {
+            const char* e = findSequence(p, end, "?>");
+            return e ? e + 2 : nullptr;
+        }
+        if (p[1] == '!') {
+            if (end - p < 4) return nullptr;
+            if (memcmp(p, "<!--", 4) == 0) {
+                const char* e = findSequence(p + 4, end, "-->");
+                return e ? e + 3 : nullptr;
+            }
+            const char* e = findTagEnd(p, end);
+            return e ? e + 1 : nullptr;
+        }
+
+        const char* e = findTagEnd(p, end);
+        if (!e) return nullptr;
+
+        if (p[1] == '/') {
+            const char* name = p + 2;
+            const char* name_end = name;
+            while (name_end < e && !isSpace(*name_end)) ++name_end;
+            closeElement(name, name_end);
+            return e + 1;
+        }
+
+        bool self_closing = e[-1] == '/';
+        const char* name = p + 1;
+        const char* name_end = name;
+        while (name_end < e && !isSpace(*name_end) && *name_end != '/') ++name_end;
+        openElement(name, name_end, self_closing ? e - 1 : e, self_closing);
+        return e + 1;
+    }
+
+    void openElement(const char* name, const char* name_end, const char* attrs_end, bool self_closing) {
+        if (nameIs(name, name_end, "nd")) {
+            if (!in_way_) return;
+            forEachAttribute(name_end, attrs_end, [&](const char* k, const char* ke, const char* v, const char* ve) {
+                if (nameIs(k, ke, "ref")) way_.node_refs.push_back(parseLongLong(v, ve));
+            });
+        } else if (nameIs(name, name_end, "member")) {
+            if (!in_relation_) return;
+            OsmMember member;
+            forEachAttribute(name_end, attrs_end, [&](const char* k, const char* ke, const char* v, const char* ve) {
+                if (nameIs(k, ke, "type")) {
+                    member.type = nameIs(v, ve, "node") ? OsmMember::kNode
+                                  : nameIs(v, ve, "way") ? OsmMember::kWay
+                                                         : OsmMember::kRelation;
+                } else if (nameIs(k, ke, "ref")) {
+                    member.ref = parseLongLong(v, ve);
+                } else if (nameIs(k, ke, "role")) {
+                    member.role = decodeValue(v, ve);
+                }
+            });
+            relation_.members.push_back(std::move(member));
+        } else if (nameIs(name, name_end, "tag")) {
+            if (!in_way_ && !in_relation_) return;
+            string key, value;
+            forEachAttribute(name_end, attrs_end, [&](const char* k, const char* ke, const char* v, const char* ve) {
+                if (nameIs(k, ke, "k")) key = decodeValue(v, ve);
+                else if (nameIs(k, ke, "v")) value = decodeValue(v, ve);
+            });
+            auto& tags = in_way_ ? way_.tags : relation_.tags;
+            tags.emplace_back(std::move(key), std::move(value));
+        } else if (nameIs(name, name_end, "node")) {
+            node_id_ = 0;
+            node_lat_ = node_lon_ = 0;
+            forEachAttribute(name_end, attrs_end, [&](const char* k, const char* ke, const char* v, const char* ve) {
+                if (nameIs(k, ke, "id")) node_id_ = parseLongLong(v, ve);
+                else if (nameIs(k, ke, "lat")) node_lat_ = parseDouble(v, ve);
+                else if (nameIs(k, ke, "lon")) node_lon_ = parseDouble(v, ve);
+            });
+            if (self_closing) handler_.node(node_id_, node_lat_, node_lon_);
+            else in_node_ = true;
+        } else if (nameIs(name, name_end, "way")) {
+            way_.id = 0;
+            way_.node_refs.clear();
+            way_.tags.clear();
+            forEachAttribute(name_end, attrs_end, [&](const char* k, const char* ke, const char* v, const char* ve) {
+                if (nameIs(k, ke, "id")) way_.id = parseLongLong(v, ve);
+            });
+            if (self_closing) handler_.way(way_);
+            else in_way_ = true;
+        } else if (nameIs(name, name_end, "relation")) {
+            relation_.id = 0;
+            relation_.members.clear();
+            relation_.tags.clear();
+            forEachAttribute(name_end, attrs_end, [&](const char* k, const char* ke, const char* v, const char* ve) {
+                if (nameIs(k, ke, "id")) relation_.id = parseLongLong(v, ve);
+            });
+            if (self_closing) handler_.relation(relation_);
+            else in_relation_ = true;
+        }
+    }
+
+    void closeElement(const char* name, const char* name_end) {
+        if (in_way_ && nameIs(name, name_end, "way")) {
+            in_way_ = false;
+            handler_.way(way_);
+        } else if (in_node_ && nameIs(name, name_end, "node")) {
+            in_node_ = false;
+            handler_.node(node_id_, node_lat_, node_lon_);
+        } else if (in_relation_ && nameIs(name, name_end, "relation")) {
+            in_relation_ = false;
+            handler_.relation(relation_);
+        }
+    }
+};
+
+// p 是否为顶层元素（node / way / relation）的开始标签
+bool isTopLevelElement(const char* p, const char* end) {
+    for (const char* name : {"node", "way", "relation"}) {
+        size_t len = strlen(name);
+        if (size_t(end - p) > len + 1 && memcmp(p + 1, name, len) == 0 &&
+            (isSpace(p[len + 1]) || p[len + 1] == '>' || p[len + 1] == '/')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 把 [begin, end) 切成大致等长的块，除第一块外都从顶层元素的开始标签处开始，
+// 每个元素完整地落在一个块里。属性值中的 '<' 必须转义，因此 '<' 只会出现在标签开头
+vector<const char*> splitAtElements(const char* begin, const char* end, size_t pieces) {
+    vector<const char*> bounds{begin};
+    size_t size = end - begin;
+    for (size_t i = 1; i < pieces; ++i) {
+        const char* p = max(begin + size / pieces * i, bounds.back());
+        while (p < end) {
+            p = static_cast<const char*>(memchr(p, '<', end - p));
+            if (!p || isTopLevelElement(p, end)) break;
+            ++p;
+        }
+        if (!p || p >= end) break;
+        if (p > bounds.back()) bounds.push_back(p);
+    }
+    bounds.push_back(end);
+    return bounds;
+}
+
+} // namespace
+
+bool readOsm(const string& path, OsmHandler& handler, unsigned threads) {
+    const string suffix = ".pbf";
+    bool pbf = path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+    return pbf ? readOsmPbf(path, handler, threads) : readOsmXml(path, handler, threads);
+}
+
+bool readOsmXml(const string& path, OsmHandler& handler, unsigned threads) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+
+    if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+    size_t batch = size_t(threads) * kChunksPerThread;
+    size_t pieces = max(min(batch, file.size() / kMinChunkSize), file.size() / kMaxChunkSize);
+    vector<const char*> bounds = splitAtElements(begin, end, max<size_t>(1, pieces));
+    size_t chunks = bounds.size() - 1;
+
+    // 各块独立解析；块边界都在顶层元素之前，因此每块解析完都不应留下不完整的标签。
+    // 与 PBF 一样分批：每批解析完按文件顺序交给处理器后释放，再解析下一批
+    for (size_t first = 0; first < chunks; first += batch) {
+        size_t count = min(batch, chunks - first);
+        vector<BufferedOsmHandler> results(chunks > 1 ? count : 0);
+        vector<char> complete(count, 0);
+        parallelFor(count, threads, [&](size_t i) {
+            OsmHandler& target = chunks > 1 ? static_cast<OsmHandler&>(results[i]) : handler;
+            OsmXmlParser parser(target);
+            complete[i] = parser.feed(bounds[first + i], bounds[first + i + 1]) == bounds[first + i + 1];
+        });
+        for (size_t i = 0; i < count; ++i) {
+            if (!complete[i]) {
+                cerr << "Truncated OSM element in " << path << endl;
+                return false;
+            }
+        }
+        for (auto& result : results) {
+            result.replay(handler);
+            result = BufferedOsmHandler();
+        }
+    }
+    return true;
+}
@@ -0,0 +1,86 @@
+#include "polyline.hpp"
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+const double kEarthRadius = 6371e3;
+// 缩放级别 0 时赤道上一个像素对应的米数
+const double kMetersPerPixelAtZoomZero = 156543.03392;
+
+void appendValue(long long value, string& out) {
+    unsigned long long bits = value < 0 ? ~((unsigned long long)value << 1) : (unsigned long long)value << 1;
+    while (bits >= 0x20) {
+        out.push_back(char((0x20 | (bits & 0x1f)) + 63));
+        bits >>= 5;
+    }
+    out.push_back(char(bits + 63));
+}
+
+} // namespace
+
+string encodePolyline(const vector<Node>& points, int precision) {
+    const double factor = pow(10.0, precision);
+    string out;
+    out.reserve(points.size() * 8);
+    long long last_lat = 0, last_lon = 0;
+    for (const Node& p : points) {
+        long long lat = llround(p.lat * factor), lon = llround(p.lon * factor);
+        appendValue(lat - last_lat, out);
+        appendValue(lon - last_lon, out);
+        last_lat = lat, last_lon = lon;
+    }
+    return out;
+}
+
+vector<Node> simplifyPolyline(const vector<Node>& points, double tolerance) {
+    if (points.size() <= 2 || tolerance <= 0) return points;
+
+    // 在首点处做局部等距圆柱投影，换算成米
+    const double meters_per_lat = kEarthRadius * M_PI / 180;
+    const double meters_per_lon = meters_per_lat * cos(points.front().lat * M_PI / 180);
+    vector<double> xs(points.size()), ys(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        xs[i] = (points[i].lon - points.front().lon) * meters_per_lon;
+        ys[i] = (points[i].lat - points.front().lat) * meters_per_lat;
+    }
+
+    vector<bool> keep(points.size(), false);
+    keep.front() = keep.back() = true;
+    const double tolerance2 = tolerance * tolerance;
+    vector<pair<size_t, size_t>> stack{{0, points.size() - 1}};
+    while (!stack.empty()) {
+        auto [first, last] = stack.back();
+        stack.pop_back();
+        double dx = xs[last] - xs[first], dy = ys[last] - ys[first];
+        double len2 = dx * dx + dy * dy;
+        double worst = -1;
+        size_t worst_index = first;
+        for (size_t i = first + 1; i < last; ++i) {
+            double t = len2 > 0 ? ((xs[i] - xs[first]) * dx + (ys[i] - ys[first]) * dy) / len2 : 0;
+            t = min(max(t, 0.0), 1.0);
+            double ex = xs[first] + t * dx - xs[i], ey = ys[first] + t * dy - ys[i];
+            double d2 = ex * ex + ey * ey;
+            if (d2 > worst) {
+                worst = d2;
+                worst_index = i;
+            }
+        }
+        if (worst > tolerance2) {
+            keep[worst_index] = true;
+            stack.push_back({first, worst_index});
+            stack.push_back({worst_index, last});
+        }
+    }
+
+    vector<Node> simplified;
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (keep[i]) simplified.push_back(points[i]);
+    }
+    return simplified;
+}
+
+double toleranceForZoom(int zoom, double lat) {
+    return kMetersPerPixelAtZoomZero * cos(lat * M_PI / 180) / pow(2.0, zoom);
+}
@@ -0,0 +1,186 @@
+#include "profile.hpp"
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace {
+
+const char* const kRoadClassNames[kRoadClassCount] = {
+    "motorway", "trunk", "primary", "secondary", "tertiary", "unclassified", "residential", "service", "other"
+};
+
+// 各等级的默认速度（km/h）
+const double kDefaultSpeeds[kRoadClassCount] = {120, 100, 60, 40, 30, 20, 20, 20, 30};
+const double kBikeSpeed = 15;
+const double kFootSpeed = 5;
+
+// 避开高速时高速公路和快速路的代价倍率：绕行不超过这个倍数的时间时宁可绕行
+const double kHighwayPenalty = 4;
+
+const double kSecondsPerHour = 3600;
+const double kMetersPerKilometer = 1000;
+
+CostProfile makeFastest() {
+    CostProfile profile;
+    profile.mode = kCar;
+    profile.objective = CostProfile::kTime;
+    for (size_t c = 0; c < kRoadClassCount; ++c) {
+        profile.speed[c] = kDefaultSpeeds[c];
+        profile.penalty[c] = 1;
+    }
+    return profile;
+}
+
+// 标签值是否表示允许 / 禁止通行；两者都不是时（例如 agricultural、unknown）不改变通行权
+bool grants(const string& value) {
+    return value == "yes" || value == "designated" || value == "permissive" || value == "destination" ||
+           value == "delivery";
+}
+bool denies(const string& value) {
+    return value == "no" || value == "private" || value == "use_sidepath" || value == "dismount";
+}
+
+// highway 取值对应的默认通行方式
+uint8_t defaultModes(const string& highway) {
+    if (highway == "motorway" || highway == "motorway_link" || highway == "motorway_junction") return kCar;
+    if (highway == "cycleway") return kBike | kFoot;
+    if (highway == "footway" || highway == "pedestrian" || highway == "steps" || highway == "corridor") return kFoot;
+    if (highway == "path" || highway == "bridleway") return kBike | kFoot;
+    if (highway == "construction" || highway == "proposed" || highway == "platform") return 0;
+    return kAllModes;
+}
+
+} // namespace
+
+TravelMode travelModeByName(string_view name) {
+    if (name == "car") return kCar;
+    if (name == "bike") return kBike;
+    if (name == "foot") return kFoot;
+    return TravelMode(0);
+}
+
+WayAccess wayAccessOf(const vector<pair<string, string>>& tags) {
+    auto tag = [&tags](const char* key) -> const string* {
+        for (const auto& [k, v] : tags) {
+            if (k == key) return &v;
+        }
+        return nullptr;
+    };
+    const string* highway = tag("highway");
+    if (!highway) return {};
+
+    uint8_t modes = defaultModes(*highway);
+    // 由宽到窄依次应用，较具体的标签覆盖较笼统的标签
+    auto apply = [&](const char* key, uint8_t affected) {
+        const string* value = tag(key);
+        if (!value) return;
+        if (grants(*value)) modes |= affected;
+        else if (denies(*value)) modes &= uint8_t(~affected);
+    };
+    apply("access", kAllModes);
+    apply("vehicle", kCar | kBike);
+    apply("motor_vehicle", kCar);
+    apply("motorcar", kCar);
+    apply("bicycle", kBike);
+    apply("foot", kFoot);
+
+    // 单行只约束车辆；-1 表示逆着节点顺序单行
+    uint8_t forward = modes, backward = modes;
+    const string* oneway = tag("oneway");
+    const string* junction = tag("junction");
+    bool forward_only = (oneway && (*oneway == "yes" || *oneway == "true" || *oneway == "1")) ||
+                        (!oneway && junction && *junction == "roundabout");
+    bool backward_only = oneway && *oneway == "-1";
+    uint8_t oneway_modes = kCar | kBike;
+    const string* oneway_bicycle = tag("oneway:bicycle");
+    const string* cycleway = tag("cycleway");
+    if ((oneway_bicycle && *oneway_bicycle == "no") || (cycleway && cycleway->rfind("opposite", 0) == 0)) {
+        oneway_modes = kCar;
+    }
+    if (forward_only) backward &= uint8_t(~oneway_modes);
+    if (backward_only) forward &= uint8_t(~oneway_modes);
+    return {forward, backward};
+}
+
+RoadClass roadClassOf(string_view highway) {
+    if (highway == "motorway") return kMotorway;
+    // motorway_junction 按快速路的速度计
+    if (highway == "trunk" || highway == "motorway_junction") return kTrunk;
+    if (highway == "primary") return kPrimary;
+    if (highway == "secondary") return kSecondary;
+    if (highway == "tertiary") return kTertiary;
+    if (highway == "unclassified") return kUnclassified;
+    if (highway == "residential") return kResidential;
+    if (highway == "service") return kService;
+    return kOtherRoad;
+}
+
+const char* roadClassName(RoadClass road_class) {
+    return kRoadClassNames[road_class];
+}
+
+RoadClass roadClassByName(string_view name) {
+    for (size_t c = 0; c < kRoadClassCount; ++c) {
+        if (name == kRoadClassNames[c]) return RoadClass(c);
+    }
+    return kRoadClassCount;
+}
+
+double CostProfile::cost(uint8_t road_class, double meters) const {
+    if (!allows(road_class)) return numeric_limits<double>::max();
+    double base = objective == kTime ? meters / speed[road_class] : meters;
+    return base * penalty[road_class];
+}
+
+double CostProfile::seconds(uint8_t road_class, double meters) const {
+    const double speed_kmh = speed[road_class] > 0 ? speed[road_class] : kDefaultSpeeds[road_class];
+    return meters / kMetersPerKilometer / speed_kmh * kSecondsPerHour;
+}
+
+double CostProfile::minCostPerMeter() const {
+    double best = numeric_limits<double>::max();
+    for (size_t c = 0; c < kRoadClassCount; ++c) {
+        if (allows(uint8_t(c))) best = min(best, cost(uint8_t(c), 1));
+    }
+    return best == numeric_limits<double>::max() ? 0 : best;
+}
+
+double CostProfile::uTurnCost() const {
+    // 按时间计费时代价的单位是 米 / (km/h)
+    return objective == kTime ? u_turn * kMetersPerKilometer / kSecondsPerHour : 0;
+}
+
+bool CostProfile::operator==(const CostProfile& other) const {
+    return mode == other.mode && objective == other.objective && equal(begin(speed), end(speed), begin(other.speed)) &&
+           equal(begin(penalty), end(penalty), begin(other.penalty)) && u_turn == other.u_turn;
+}
+
+const CostProfile& CostProfile::fastest() {
+    static const CostProfile profile = makeFastest();
+    return profile;
+}
+
+CostProfile CostProfile::forMode(TravelMode mode) {
+    CostProfile profile = fastest();
+    profile.mode = mode;
+    if (mode == kCar) return profile;
+    // 自行车和步行的速度与道路等级无关
+    for (size_t c = 0; c < kRoadClassCount; ++c) profile.speed[c] = mode == kBike ? kBikeSpeed : kFootSpeed;
+    return profile;
+}
+
+bool CostProfile::named(string_view name, TravelMode mode, CostProfile& profile) {
+    profile = forMode(mode);
+    if (name == "fastest") return true;
+    if (name == "shortest") {
+        profile.objective = kDistance;
+        return true;
+    }
+    if (name == "avoid-highway") {
+        profile.penalty[kMotorway] = kHighwayPenalty;
+        profile.penalty[kTrunk] = kHighwayPenalty;
+        return true;
+    }
+    return false;
+}
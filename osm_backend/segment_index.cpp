@@ -0,0 +1,221 @@
+#include "segment_index.hpp"
+#include "snapshot.hpp"
+
+using namespace std;
+
+namespace {
+
+const double kEarthRadius = 6371e3;
+// 单元边长的取值范围（米）
+const double kMinCellSize = 25;
+const double kMaxCellSize = 2000;
+// 平均每个单元登记的路段数
+const double kSegmentsPerCell = 2;
+
+} // namespace
+
+void SegmentIndex::build(const Graph& graph) {
+    // 每条路段的两端顶点与正反方向的边
+    size_t chain_count = graph.chainCount();
+    vector<Index> first(chain_count, Graph::kInvalidIndex), last(chain_count, Graph::kInvalidIndex);
+    vector<uint32_t> forward(chain_count, Graph::kInvalidEdge), backward(chain_count, Graph::kInvalidEdge);
+    for (Index v = 0; v < graph.vertexCount(); ++v) {
+        for (uint32_t e = graph.edgeBegin(v); e < graph.edgeEnd(v); ++e) {
+            uint32_t c = graph.edgeChain(e);
+            if (graph.edgeReversed(e)) {
+                backward[c] = e;
+                first[c] = graph.edgeTarget(e);
+                last[c] = v;
+            } else {
+                forward[c] = e;
+                first[c] = v;
+                last[c] = graph.edgeTarget(e);
+            }
+        }
+    }
+    size_t piece_count = 0;
+    for (uint32_t c = 0; c < chain_count; ++c) {
+        if (first[c] != Graph::kInvalidIndex) piece_count += graph.chainEnd(c) - graph.chainBegin(c) + 1;
+    }
+    if (piece_count == 0) return;
+
+    double min_lat = 90, max_lat = -90, min_lon = 180, max_lon = -180;
+    for (Index v = 0; v < graph.vertexCount(); ++v) {
+        min_lat = min(min_lat, graph.latOf(v));
+        max_lat = max(max_lat, graph.latOf(v));
+        min_lon = min(min_lon, graph.lonOf(v));
+        max_lon = max(max_lon, graph.lonOf(v));
+    }
+    // 形状点可能落在顶点的包围盒之外
+    for (uint32_t c = 0; c < chain_count; ++c) {
+        for (const ShapePoint* p = graph.chainBegin(c); p != graph.chainEnd(c); ++p) {
+            min_lat = min(min_lat, p->lat);
+            max_lat = max(max_lat, p->lat);
+            min_lon = min(min_lon, p->lon);
+            max_lon = max(max_lon, p->lon);
+        }
+    }
+    grid_.origin_lat = min_lat;
+    grid_.origin_lon = min_lon;
+    grid_.meters_per_lat = kEarthRadius * M_PI / 180;
+    grid_.meters_per_lon = grid_.meters_per_lat * cos((min_lat + max_lat) / 2 * M_PI / 180);
+    double width = (max_lon - min_lon) * grid_.meters_per_lon;
+    double height = (max_lat - min_lat) * grid_.meters_per_lat;
+    grid_.cell_size = sqrt(max(width * height, 1.0) * kSegmentsPerCell / piece_count);
+    grid_.cell_size = min(max(grid_.cell_size, kMinCellSize), kMaxCellSize);
+    grid_.columns = uint32_t(width / grid_.cell_size) + 1;
+    grid_.rows = uint32_t(height / grid_.cell_size) + 1;
+
+    vector<Segment> segments;
+    segments.reserve(piece_count);
+    for (uint32_t c = 0; c < chain_count; ++c) {
+        if (first[c] == Graph::kInvalidIndex) continue;
+        uint32_t edge = forward[c] != Graph::kInvalidEdge ? forward[c] : backward[c];
+        double length = graph.edgeLength(edge);
+        uint8_t modes = 0;
+        if (forward[c] != Graph::kInvalidEdge) modes |= graph.edgeModes(forward[c]);
+        if (backward[c] != Graph::kInvalidEdge) modes |= graph.edgeModes(backward[c]);
+        uint8_t main = graph.componentOf(first[c]) == 0;
+        // 依次连接 起点、各形状点、终点
+        double lat = graph.latOf(first[c]), lon = graph.lonOf(first[c]), t = 0;
+        auto append = [&](double next_lat, double next_lon, double next_t) {
+            segments.push_back({first[c], last[c], forward[c], backward[c], graph.edgeClass(edge), modes, main, 0,
+                                float(t), float(next_t),
+                                float((lon - min_lon) * grid_.meters_per_lon), float((lat - min_lat) * grid_.meters_per_lat),
+                                float((next_lon - min_lon) * grid_.meters_per_lon), float((next_lat - min_lat) * grid_.meters_per_lat)});
+            lat = next_lat, lon = next_lon, t = next_t;
+        };
+        for (const ShapePoint* p = graph.chainBegin(c); p != graph.chainEnd(c); ++p) {
+            append(p->lat, p->lon, length > 0 ? p->offset / length : 0);
+        }
+        append(graph.latOf(last[c]), graph.lonOf(last[c]), 1);
+    }
+
+    // 两遍计数排序：先数每个单元的路段数，再填入
+    auto forEachCell = [this](const Segment& s, auto visit) {
+        uint32_t col0 = min(uint32_t(min(s.ax, s.bx) / grid_.cell_size), grid_.columns - 1);
+        uint32_t col1 = min(uint32_t(max(s.ax, s.bx) / grid_.cell_size), grid_.columns - 1);
+        uint32_t row0 = min(uint32_t(min(s.ay, s.by) / grid_.cell_size), grid_.rows - 1);
+        uint32_t row1 = min(uint32_t(max(s.ay, s.by) / grid_.cell_size), grid_.rows - 1);
+        for (uint32_t row = row0; row <= row1; ++row) {
+            for (uint32_t col = col0; col <= col1; ++col) visit(row * grid_.columns + col);
+        }
+    };
+    size_t cell_count = size_t(grid_.columns) * grid_.rows;
+    vector<uint32_t> offsets(cell_count + 1, 0);
+    for (const auto& s : segments) forEachCell(s, [&](size_t c) { ++offsets[c + 1]; });
+    for (size_t c = 0; c < cell_count; ++c) offsets[c + 1] += offsets[c];
+    vector<uint32_t> items(offsets.back());
+    vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < segments.size(); ++i) forEachCell(segments[i], [&](size_t c) { items[cursor[c]++] = i; });
+
+    segments_.assign(std::move(segments));
+    cell_offsets_.assign(std::move(offsets));
+    cell_segments_.assign(std::move(items));
+}
+
+bool SegmentIndex::nearest(double lat, double lon, RoadPosition& position, const CostProfile* profile) const {
+    if (empty()) return false;
+    const CostProfile& costs = profile ? *profile : CostProfile::fastest();
+    const double cell = grid_.cell_size;
+    double x = (lon - grid_.origin_lon) * grid_.meters_per_lon;
+    double y = (lat - grid_.origin_lat) * grid_.meters_per_lat;
+    // 查询点在网格外时，从网格上离它最近的点开始扩展；网格是凸的，
+    // 该点到各单元的距离不超过查询点到各单元的距离，因此下面的停止条件仍然成立
+    double px = min(max(x, 0.0), grid_.columns * cell);
+    double py = min(max(y, 0.0), grid_.rows * cell);
+    int64_t col = min<int64_t>(int64_t(px / cell), grid_.columns - 1);
+    int64_t row = min<int64_t>(int64_t(py / cell), grid_.rows - 1);
+
+    // 全部路段中和最大连通分量里最近的路段，距离均为平方
+    double best = numeric_limits<double>::max(), best_main = numeric_limits<double>::max();
+    uint32_t best_segment = 0, main_segment = 0;
+    double best_t = 0, main_t = 0;
+    auto scanCell = [&](int64_t c, int64_t r) {
+        if (c < 0 || r < 0 || c >= grid_.columns || r >= grid_.rows) return;
+        size_t index = size_t(r) * grid_.columns + size_t(c);
+        for (uint32_t i = cell_offsets_[index]; i < cell_offsets_[index + 1]; ++i) {
+            const Segment& s = segments_[cell_segments_[i]];
+            if (!(s.modes & costs.mode) || !costs.allows(s.road_class)) continue;
+            double dx = s.bx - s.ax, dy = s.by - s.ay;
+            double len2 = dx * dx + dy * dy;
+            double t = len2 > 0 ? ((x - s.ax) * dx + (y - s.ay) * dy) / len2 : 0;
+            t = min(max(t, 0.0), 1.0);
+            double ex = s.ax + t * dx - x, ey = s.ay + t * dy - y;
+            double d2 = ex * ex + ey * ey;
+            if (d2 < best) {
+                best = d2;
+                best_segment = cell_segments_[i];
+                best_t = t;
+            }
+            if (s.main && d2 < best_main) {
+                best_main = d2;
+                main_segment = cell_segments_[i];
+                main_t = t;
+            }
+        }
+    };
+
+    int64_t max_ring = max(grid_.columns, grid_.rows);
+    for (int64_t ring = 0; ring <= max_ring; ++ring) {
+        if (ring > 0) {
+            // 第 ring 圈位于前面各圈组成的方块之外，离起点至少是起点到方块边界的距离
+            double reach = min({px - (col - ring + 1) * cell, (col + ring) * cell - px,
+                                py - (row - ring + 1) * cell, (row + ring) * cell - py});
+            // 最近的路段不在最大连通分量里时，还要继续找到其中最近的路段，或确认它远出了余量
+            if (reach * reach >= best &&
+                (reach * reach >= best_main || reach >= sqrt(best) + kMainComponentMargin)) break;
+        }
+        if (ring == 0) {
+            scanCell(col, row);
+            continue;
+        }
+        for (int64_t c = col - ring; c <= col + ring; ++c) {
+            scanCell(c, row - ring);
+            scanCell(c, row + ring);
+        }
+        for (int64_t r = row - ring + 1; r <= row + ring - 1; ++r) {
+            scanCell(col - ring, r);
+            scanCell(col + ring, r);
+        }
+    }
+    if (best == numeric_limits<double>::max()) return false;
+    if (best_main != numeric_limits<double>::max() && sqrt(best_main) <= sqrt(best) + kMainComponentMargin) {
+        best_segment = main_segment;
+        best_t = main_t;
+    }
+
+    const Segment& s = segments_[best_segment];
+    double proj_x = s.ax + best_t * (s.bx - s.ax), proj_y = s.ay + best_t * (s.by - s.ay);
+    position.from = s.a;
+    position.to = s.b;
+    position.forward = s.forward;
+    position.backward = s.backward;
+    position.fraction = s.t0 + best_t * (s.t1 - s.t0);
+    position.lat = grid_.origin_lat + proj_y / grid_.meters_per_lat;
+    position.lon = grid_.origin_lon + proj_x / grid_.meters_per_lon;
+    position.meters = calculateDistanceWithLatAndLon(lat, lon, position.lat, position.lon);
+    return true;
+}
+
+void SegmentIndex::save(SnapshotWriter& writer) const {
+    writer.add(sectionTag("SGGD"), &grid_, 1);
+    writer.add(sectionTag("SGSG"), segments_.data(), segments_.size());
+    writer.add(sectionTag("SGOF"), cell_offsets_.data(), cell_offsets_.size());
+    writer.add(sectionTag("SGIX"), cell_segments_.data(), cell_segments_.size());
+}
+
+bool SegmentIndex::load(const SnapshotReader& reader) {
+    size_t grid_count, segment_count, offset_count, item_count;
+    const Grid* grid = reader.get<Grid>(sectionTag("SGGD"), grid_count);
+    const Segment* segments = reader.get<Segment>(sectionTag("SGSG"), segment_count);
+    const uint32_t* offsets = reader.get<uint32_t>(sectionTag("SGOF"), offset_count);
+    const uint32_t* items = reader.get<uint32_t>(sectionTag("SGIX"), item_count);
+    if (!grid || !segments || !offsets || !items || grid_count != 1) return false;
+    if (segment_count > 0 && offset_count != size_t(grid->columns) * grid->rows + 1) return false;
+    grid_ = *grid;
+    segments_.attach(segments, segment_count);
+    cell_offsets_.attach(offsets, offset_count);
+    cell_segments_.attach(items, item_count);
+    return true;
+}
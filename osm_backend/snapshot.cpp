@@ -0,0 +1,224 @@
+#include "snapshot.hpp"
+#include "graph.hpp"
+#include "ch.hpp"
+#include "alt.hpp"
+#include "segment_index.hpp"
+#include "spatial_index.hpp"
+#include "way_table.hpp"
+#include <cstdio>
+#include <iostream>
+#include <memory>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t section_count;
+    uint32_t reserved;
+};
+
+struct SectionEntry {
+    uint32_t tag;
+    uint32_t elem_size;
+    uint64_t offset;
+    uint64_t count;
+};
+
+const uint64_t kSectionAlignment = 64;
+
+uint64_t alignUp(uint64_t v) {
+    return (v + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+}
+
+
+} // namespace
+
+bool MappedFile::open(const string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    file_ = file;
+    mapping_ = mapping;
+    data_ = static_cast<const char*>(view);
+    size_ = size_t(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // 映射建立后文件描述符可以关闭
+    if (view == MAP_FAILED) return false;
+    data_ = static_cast<const char*>(view);
+    size_ = size_t(st.st_size);
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+    if (!data_) return;
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+    CloseHandle(file_);
+    mapping_ = file_ = nullptr;
+#else
+    munmap(const_cast<char*>(data_), size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+bool SnapshotWriter::write(const string& path) const {
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) return false;
+
+    SnapshotHeader header{kSnapshotMagic, kSnapshotVersion, uint32_t(sections_.size()), 0};
+    vector<SectionEntry> entries;
+    uint64_t offset = alignUp(sizeof(header) + sizeof(SectionEntry) * sections_.size());
+    for (const auto& s : sections_) {
+        entries.push_back({s.tag, s.elem_size, offset, s.count});
+        offset = alignUp(offset + s.bytes.size());
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    if (!entries.empty()) ok = ok && fwrite(entries.data(), sizeof(SectionEntry), entries.size(), out) == entries.size();
+    uint64_t written = sizeof(header) + sizeof(SectionEntry) * entries.size();
+    static const char zeros[kSectionAlignment] = {};
+    for (size_t i = 0; ok && i < sections_.size(); ++i) {
+        ok = fwrite(zeros, 1, entries[i].offset - written, out) == entries[i].offset - written;
+        if (!sections_[i].bytes.empty()) {
+            ok = ok && fwrite(sections_[i].bytes.data(), 1, sections_[i].bytes.size(), out) == sections_[i].bytes.size();
+        }
+        written = entries[i].offset + sections_[i].bytes.size();
+    }
+    return fclose(out) == 0 && ok;
+}
+
+bool SnapshotReader::open(const string& path) {
+    if (!file_.open(path)) return false;
+    if (file_.size() < sizeof(SnapshotHeader)) return false;
+    const auto* header = reinterpret_cast<const SnapshotHeader*>(file_.data());
+    if (header->magic != kSnapshotMagic) {
+        cerr << path << " is not a graph snapshot" << endl;
+        return false;
+    }
+    if (header->version != kSnapshotVersion) {
+        cerr << path << " has snapshot version " << header->version
+             << ", expected " << kSnapshotVersion << endl;
+        return false;
+    }
+    return sizeof(SnapshotHeader) + sizeof(SectionEntry) * uint64_t(header->section_count) <= file_.size();
+}
+
+const char* SnapshotReader::find(uint32_t tag, uint32_t elem_size, size_t& count) const {
+    count = 0;
+    const auto* header = reinterpret_cast<const SnapshotHeader*>(file_.data());
+    const auto* entries = reinterpret_cast<const SectionEntry*>(file_.data() + sizeof(SnapshotHeader));
+    for (uint32_t i = 0; i < header->section_count; ++i) {
+        const SectionEntry& e = entries[i];
+        if (e.tag != tag) continue;
+        if (e.elem_size != elem_size || e.offset + e.count * e.elem_size > file_.size()) return nullptr;
+        count = size_t(e.count);
+        return file_.data() + e.offset;
+    }
+    return nullptr;
+}
+
+bool saveGraphSnapshot(const string& path) {
+    SnapshotWriter writer;
+
+    graph.save(writer);
+    hierarchy.save(writer);
+    landmarks.save(writer);
+
+    way_table.save(writer);
+    kdtree.save(writer);
+    grid_index.save(writer);
+    road_segments.save(writer);
+
+    return writer.write(path);
+}
+
+bool loadGraphSnapshot(const string& path) {
+    // 各段先读进局部对象，全部校验通过后才替换全局数据：中途失败时全局数据保持原样，
+    // 调用方可以放心退回 initialize() 重新建图
+    auto reader = make_unique<SnapshotReader>();
+    if (!reader->open(path)) return false;
+
+    WayTable loaded_way_table;
+    Graph loaded_graph;
+    ContractionHierarchy loaded_hierarchy;
+    Landmarks loaded_landmarks;
+    KDTree loaded_kdtree;
+    GridIndex loaded_grid_index;
+    SegmentIndex loaded_road_segments;
+    if (!loaded_way_table.load(*reader)) {
+        cerr << path << " has a corrupt way table section" << endl;
+        return false;
+    }
+    if (!loaded_graph.load(*reader)) {
+        cerr << path << " has a corrupt adjacency section" << endl;
+        return false;
+    }
+    if (!loaded_hierarchy.load(*reader)) {
+        cerr << path << " has a corrupt contraction hierarchy section" << endl;
+        return false;
+    }
+    if (!loaded_landmarks.load(*reader)) {
+        cerr << path << " has a corrupt landmark section" << endl;
+        return false;
+    }
+    if (!loaded_kdtree.load(*reader) || !loaded_grid_index.load(*reader) || !loaded_road_segments.load(*reader)) {
+        cerr << path << " is missing the spatial index section" << endl;
+        return false;
+    }
+
+    way_table = std::move(loaded_way_table);
+    graph = std::move(loaded_graph);
+    hierarchy = std::move(loaded_hierarchy);
+    landmarks = std::move(loaded_landmarks);
+    kdtree = std::move(loaded_kdtree);
+    grid_index = std::move(loaded_grid_index);
+    road_segments = std::move(loaded_road_segments);
+    // 图的 CSR 数组直接引用映射内存，映射需要保持到进程退出；旧映射此时已无人引用
+    static unique_ptr<SnapshotReader> mapped;
+    mapped = std::move(reader);
+    return true;
+}
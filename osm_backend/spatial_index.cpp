@@ -0,0 +1,289 @@
+#include "spatial_index.hpp"
+#include "snapshot.hpp"
+
+using namespace std;
+
+namespace {
+
+const double kEarthRadius = 6371e3;
+// 网格单元边长的取值范围（米）
+const double kMinCellSize = 10;
+const double kMaxCellSize = 2000;
+// 平均每个单元的点数
+const double kPointsPerCell = 2;
+
+double coordinate(const KDTree::Point& p, uint32_t axis) {
+    return axis == 0 ? p.x : axis == 1 ? p.y : p.z;
+}
+
+// 道路上的全部节点：顶点之后依次是各路段的形状点
+vector<Node> roadNodes(const Graph& graph) {
+    vector<Node> nodes;
+    nodes.reserve(graph.vertexCount());
+    for (Graph::Index v = 0; v < graph.vertexCount(); ++v) nodes.push_back(graph.node(v));
+    for (uint32_t c = 0; c < graph.chainCount(); ++c) {
+        for (const ShapePoint* p = graph.chainBegin(c); p != graph.chainEnd(c); ++p) nodes.push_back({p->id, p->lat, p->lon});
+    }
+    return nodes;
+}
+
+} // namespace
+
+long long findNearestNode(double targetLat, double targetLon) {
+    return spatial_index->findNearestNode(targetLat, targetLon);
+}
+
+long long findNearestConnectedNode(double targetLat, double targetLon) {
+    // 最近的几个顶点中优先取最大连通分量里的，避免吸附到孤立的小块路网上。
+    // 候选里的形状点不算；长路段上最近的若干节点可能都是形状点，此时扩大候选范围再找
+    const size_t kCandidates = 8;
+    const size_t kGrowth = 8;
+    vector<Neighbor> candidates(kCandidates);
+    long long fallback = 0;
+    for (;;) {
+        size_t count = spatial_index->nearest(targetLat, targetLon, candidates.size(), candidates.data());
+        size_t vertices = 0;
+        for (size_t i = 0; i < count; ++i) {
+            Graph::Index v = graph.indexOf(candidates[i].id);
+            if (v == Graph::kInvalidIndex) continue;
+            if (graph.componentOf(v) == 0) return candidates[i].id;
+            if (!fallback) fallback = candidates[i].id;
+            ++vertices;
+        }
+        if (vertices >= kCandidates || count < candidates.size()) return fallback;
+        candidates.resize(candidates.size() * kGrowth);
+    }
+}
+
+KDTree::Point KDTree::Point::fromLatLon(double lat, double lon, long long id) {
+    double phi = lat * M_PI / 180, lambda = lon * M_PI / 180;
+    return {cos(phi) * cos(lambda), cos(phi) * sin(lambda), sin(phi), lat, lon, id, 0, 0};
+}
+
+void KDTree::build(const Graph& graph) {
+    vector<Point> points;
+    for (const Node& node : roadNodes(graph)) points.push_back(Point::fromLatLon(node.lat, node.lon, node.id));
+
+    // 用显式栈代替递归；每个区间沿跨度最大的一维把中位数放到中点，再分别划分左右两半。
+    // 一个城市内的点在球面上几乎共面，固定轮换三个维度会浪费一半的划分
+    struct Range { size_t lo, hi; };
+    vector<Range> stack{{0, points.size()}};
+    while (!stack.empty()) {
+        Range r = stack.back();
+        stack.pop_back();
+        if (r.lo >= r.hi) continue;
+        double low[3] = {1, 1, 1}, high[3] = {-1, -1, -1};
+        for (size_t i = r.lo; i < r.hi; ++i) {
+            for (uint32_t k = 0; k < 3; ++k) {
+                low[k] = min(low[k], coordinate(points[i], k));
+                high[k] = max(high[k], coordinate(points[i], k));
+            }
+        }
+        uint32_t axis = 0;
+        for (uint32_t k = 1; k < 3; ++k) {
+            if (high[k] - low[k] > high[axis] - low[axis]) axis = k;
+        }
+        size_t mid = (r.lo + r.hi) / 2;
+        nth_element(points.begin() + r.lo, points.begin() + mid, points.begin() + r.hi,
+                    [axis](const Point& a, const Point& b) { return coordinate(a, axis) < coordinate(b, axis); });
+        points[mid].axis = axis;
+        stack.push_back({r.lo, mid});
+        stack.push_back({mid + 1, r.hi});
+    }
+    points_.assign(std::move(points));
+}
+
+size_t KDTree::nearest(double targetLat, double targetLon, size_t k, Neighbor* out) const {
+    NeighborHeap heap(out, k, numeric_limits<double>::max());
+    return search(targetLat, targetLon, heap);
+}
+
+size_t KDTree::withinRadius(double targetLat, double targetLon, double meters, Neighbor* out, size_t capacity) const {
+    // 球面距离 d 对应单位球上的弦长 2 sin(d / 2R)
+    double chord = 2 * sin(min(meters / kEarthRadius, M_PI) / 2);
+    NeighborHeap heap(out, capacity, chord * chord);
+    return search(targetLat, targetLon, heap);
+}
+
+size_t KDTree::search(double targetLat, double targetLon, NeighborHeap& heap) const {
+    // 迭代搜索：先沿目标所在的一侧下降，另一侧连同到分割面的距离压栈，出栈时再判断能否剪枝。
+    // 树是平衡的，栈深不超过树高
+    struct Frame {
+        uint32_t lo, hi;
+        double plane;
+    };
+    Frame stack[64];
+    size_t top = 0;
+    stack[top++] = {0, uint32_t(points_.size()), 0};
+
+    const Point target = Point::fromLatLon(targetLat, targetLon, 0);
+    while (top > 0) {
+        Frame f = stack[--top];
+        if (f.plane * f.plane > heap.limit()) continue;
+        while (f.lo < f.hi) {
+            uint32_t mid = (f.lo + f.hi) / 2;
+            const Point& p = points_[mid];
+            double dx = p.x - target.x, dy = p.y - target.y, dz = p.z - target.z;
+            heap.offer(mid, dx * dx + dy * dy + dz * dz);
+
+            double plane = coordinate(target, p.axis) - coordinate(p, p.axis);
+            Frame left{f.lo, mid, plane}, right{mid + 1, f.hi, plane};
+            const Frame& far = plane < 0 ? right : left;
+            if (far.lo < far.hi && plane * plane <= heap.limit()) stack[top++] = far;
+            f = plane < 0 ? left : right;
+        }
+    }
+
+    // 只对最终结果计算球面距离
+    size_t count = heap.finish();
+    Neighbor* out = heap.data();
+    for (size_t i = 0; i < count; ++i) {
+        const Point& p = points_[size_t(out[i].id)];
+        out[i] = {p.id, calculateDistanceWithLatAndLon(targetLat, targetLon, p.lat, p.lon), p.lat, p.lon};
+    }
+    return count;
+}
+
+void KDTree::save(SnapshotWriter& writer) const {
+    writer.add(sectionTag("KDTR"), points_.data(), points_.size());
+}
+
+bool KDTree::load(const SnapshotReader& reader) {
+    size_t count;
+    const Point* points = reader.get<Point>(sectionTag("KDTR"), count);
+    if (!points) return false;
+    points_.attach(points, count);
+    return true;
+}
+
+void GridIndex::build(const Graph& graph) {
+    vector<Node> points = roadNodes(graph);
+    grid_ = {};
+    if (points.empty()) {
+        cell_offsets_.assign({});
+        entries_.assign({});
+        return;
+    }
+
+    double min_lat = 90, max_lat = -90, min_lon = 180, max_lon = -180;
+    for (const Node& node : points) {
+        min_lat = min(min_lat, node.lat);
+        max_lat = max(max_lat, node.lat);
+        min_lon = min(min_lon, node.lon);
+        max_lon = max(max_lon, node.lon);
+    }
+    grid_.origin_lat = min_lat;
+    grid_.origin_lon = min_lon;
+    grid_.meters_per_lat = kEarthRadius * M_PI / 180;
+    grid_.meters_per_lon = grid_.meters_per_lat * cos((min_lat + max_lat) / 2 * M_PI / 180);
+    double width = (max_lon - min_lon) * grid_.meters_per_lon;
+    double height = (max_lat - min_lat) * grid_.meters_per_lat;
+    grid_.cell_size = sqrt(max(width * height, 1.0) * kPointsPerCell / points.size());
+    grid_.cell_size = min(max(grid_.cell_size, kMinCellSize), kMaxCellSize);
+    grid_.columns = uint32_t(width / grid_.cell_size) + 1;
+    grid_.rows = uint32_t(height / grid_.cell_size) + 1;
+
+    // 两遍计数排序：同一单元的点连续存放，查询时顺序扫描
+    vector<Entry> projected;
+    vector<uint32_t> cells;
+    projected.reserve(points.size());
+    cells.reserve(points.size());
+    for (const Node& node : points) {
+        Entry e{float((node.lon - min_lon) * grid_.meters_per_lon), float((node.lat - min_lat) * grid_.meters_per_lat), node.id,
+                node.lat, node.lon};
+        uint32_t col = min(uint32_t(e.x / grid_.cell_size), grid_.columns - 1);
+        uint32_t row = min(uint32_t(e.y / grid_.cell_size), grid_.rows - 1);
+        projected.push_back(e);
+        cells.push_back(row * grid_.columns + col);
+    }
+    size_t cell_count = size_t(grid_.columns) * grid_.rows;
+    vector<uint32_t> offsets(cell_count + 1, 0);
+    for (uint32_t c : cells) ++offsets[c + 1];
+    for (size_t c = 0; c < cell_count; ++c) offsets[c + 1] += offsets[c];
+    vector<Entry> entries(projected.size());
+    vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < projected.size(); ++i) entries[cursor[cells[i]]++] = projected[i];
+
+    cell_offsets_.assign(std::move(offsets));
+    entries_.assign(std::move(entries));
+}
+
+size_t GridIndex::nearest(double lat, double lon, size_t k, Neighbor* out) const {
+    NeighborHeap heap(out, k, numeric_limits<double>::max());
+    return search(lat, lon, heap);
+}
+
+size_t GridIndex::withinRadius(double lat, double lon, double meters, Neighbor* out, size_t capacity) const {
+    NeighborHeap heap(out, capacity, meters * meters);
+    return search(lat, lon, heap);
+}
+
+size_t GridIndex::search(double lat, double lon, NeighborHeap& heap) const {
+    if (empty()) return 0;
+    const double cell = grid_.cell_size;
+    double x = (lon - grid_.origin_lon) * grid_.meters_per_lon;
+    double y = (lat - grid_.origin_lat) * grid_.meters_per_lat;
+    // 查询点在网格外时，从网格上离它最近的点开始扩展（见 SegmentIndex::nearest）
+    double px = min(max(x, 0.0), grid_.columns * cell);
+    double py = min(max(y, 0.0), grid_.rows * cell);
+    int64_t col = min<int64_t>(int64_t(px / cell), grid_.columns - 1);
+    int64_t row = min<int64_t>(int64_t(py / cell), grid_.rows - 1);
+
+    auto scanCell = [&](int64_t c, int64_t r) {
+        if (c < 0 || r < 0 || c >= grid_.columns || r >= grid_.rows) return;
+        size_t index = size_t(r) * grid_.columns + size_t(c);
+        for (uint32_t i = cell_offsets_[index]; i < cell_offsets_[index + 1]; ++i) {
+            double dx = entries_[i].x - x, dy = entries_[i].y - y;
+            heap.offer(i, dx * dx + dy * dy);
+        }
+    };
+
+    int64_t max_ring = max(grid_.columns, grid_.rows);
+    for (int64_t ring = 0; ring <= max_ring; ++ring) {
+        if (ring > 0) {
+            // 第 ring 圈位于前面各圈组成的方块之外，离起点至少是起点到方块边界的距离
+            double reach = min({px - (col - ring + 1) * cell, (col + ring) * cell - px,
+                                py - (row - ring + 1) * cell, (row + ring) * cell - py});
+            if (reach * reach > heap.limit()) break;
+        }
+        if (ring == 0) {
+            scanCell(col, row);
+            continue;
+        }
+        for (int64_t c = col - ring; c <= col + ring; ++c) {
+            scanCell(c, row - ring);
+            scanCell(c, row + ring);
+        }
+        for (int64_t r = row - ring + 1; r <= row + ring - 1; ++r) {
+            scanCell(col - ring, r);
+            scanCell(col + ring, r);
+        }
+    }
+
+    size_t count = heap.finish();
+    Neighbor* out = heap.data();
+    for (size_t i = 0; i < count; ++i) {
+        const Entry& e = entries_[size_t(out[i].id)];
+        out[i] = {e.id, calculateDistanceWithLatAndLon(lat, lon, e.lat, e.lon), e.lat, e.lon};
+    }
+    return count;
+}
+
+void GridIndex::save(SnapshotWriter& writer) const {
+    writer.add(sectionTag("PGGD"), &grid_, 1);
+    writer.add(sectionTag("PGOF"), cell_offsets_.data(), cell_offsets_.size());
+    writer.add(sectionTag("PGPT"), entries_.data(), entries_.size());
+}
+
+bool GridIndex::load(const SnapshotReader& reader) {
+    size_t grid_count, offset_count, entry_count;
+    const Grid* grid = reader.get<Grid>(sectionTag("PGGD"), grid_count);
+    const uint32_t* offsets = reader.get<uint32_t>(sectionTag("PGOF"), offset_count);
+    const Entry* entries = reader.get<Entry>(sectionTag("PGPT"), entry_count);
+    if (!grid || !offsets || !entries || grid_count != 1) return false;
+    if (entry_count > 0 && offset_count != size_t(grid->columns) * grid->rows + 1) return false;
+    grid_ = *grid;
+    cell_offsets_.attach(offsets, offset_count);
+    entries_.attach(entries, entry_count);
+    return true;
+}
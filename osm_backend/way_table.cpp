@@ -0,0 +1,56 @@
+#include "way_table.hpp"
+#include "snapshot.hpp"
+
+using namespace std;
+
+uint32_t WayTable::intern(const string& s) {
+    auto [it, inserted] = interned_.try_emplace(s, uint32_t(pending_offsets_.size() - 1));
+    if (inserted) {
+        pending_chars_.insert(pending_chars_.end(), s.begin(), s.end());
+        pending_offsets_.push_back(uint32_t(pending_chars_.size()));
+    }
+    return it->second;
+}
+
+uint32_t WayTable::add(long long id, WayAccess access, double speed_limit, const string& highway, const string& name) {
+    Record r{};
+    r.id = id;
+    r.speed_limit = speed_limit;
+    r.highway = intern(highway);
+    r.name = intern(name);
+    r.forward_modes = access.forward;
+    r.backward_modes = access.backward;
+    pending_records_.push_back(r);
+    return uint32_t(pending_records_.size() - 1);
+}
+
+void WayTable::freeze() {
+    records_.assign(std::move(pending_records_));
+    string_offsets_.assign(std::move(pending_offsets_));
+    chars_.assign(std::move(pending_chars_));
+    pending_records_ = vector<Record>();
+    pending_offsets_ = vector<uint32_t>{0};
+    pending_chars_ = vector<char>();
+    interned_ = unordered_map<string, uint32_t>();
+}
+
+void WayTable::save(SnapshotWriter& writer) const {
+    writer.add(sectionTag("WAYS"), records_.data(), records_.size());
+    writer.add(sectionTag("WSOF"), string_offsets_.data(), string_offsets_.size());
+    writer.add(sectionTag("STRS"), chars_.data(), chars_.size());
+}
+
+bool WayTable::load(const SnapshotReader& reader) {
+    size_t record_count, offset_count, char_count;
+    const Record* records = reader.get<Record>(sectionTag("WAYS"), record_count);
+    const uint32_t* offsets = reader.get<uint32_t>(sectionTag("WSOF"), offset_count);
+    const char* chars = reader.get<char>(sectionTag("STRS"), char_count);
+    if (!records || !offsets || !chars || offset_count == 0 || offsets[offset_count - 1] != char_count) return false;
+    for (size_t i = 0; i < record_count; ++i) {
+        if (records[i].highway + 1 >= offset_count || records[i].name + 1 >= offset_count) return false;
+    }
+    records_.attach(records, record_count);
+    string_offsets_.attach(offsets, offset_count);
+    chars_.attach(chars, char_count);
+    return true;
+}
@@ -2,14 +2,76 @@
 #include <unordered_map>
 #include <vector>
 #include <chrono>
-#include "pugixml.hpp"
+#include <mutex>
+#include <thread>
+#include <random>
+#include <sstream>
 #include "graph.hpp"
+#include "ch.hpp"
+#include "alt.hpp"
+#include "matrix.hpp"
+#include "parallel.hpp"
+#include "polyline.hpp"
+#include "segment_index.hpp"
+#include "spatial_index.hpp"
+#include "way_table.hpp"
+#include "metrics.hpp"
+#include "osm_reader.hpp"
+#include "snapshot.hpp"
 #include "httplib.h"
 #include "nlohmann/json.hpp"
 
-using namespace pugi;
 using json = nlohmann::json;
 
+// 多个工作线程共用标准输出，只用于少量的错误信息；请求日志由 metrics 后台线程批量写出
+std::mutex log_mutex;
+
+void writeLog(const std::string& text) {
+    std::lock_guard<std::mutex> lock(log_mutex);
+    cout << text << std::flush;
+}
+
+// 处理请求的工作线程池。图和各种索引加载后只读，可被所有线程共享；
+// 每个任务开始前确保本线程的搜索空间已按图的规模分配好，查询过程中不再扩容
+class WorkerPool : public httplib::TaskQueue {
+public:
+    explicit WorkerPool(size_t threads) : pool_(threads) {}
+
+    bool enqueue(std::function<void()> fn) override {
+        return pool_.enqueue([fn = std::move(fn)] {
+            graph.reserveWorkspaces();
+            fn();
+        });
+    }
+    void shutdown() override { pool_.shutdown(); }
+
+private:
+    httplib::ThreadPool pool_;
+};
+
+// 请求中的代价配置："mode" 为出行方式（car / bike / foot，缺省为 car），"profile" 为预设名称（缺省为 fastest），
+// "speeds" 按道路等级覆盖速度（km/h，0 表示禁止通行），"u_turn" 为每次掉头附加的秒数（缺省为 0）
+CostProfile parseProfile(const json& request) {
+    CostProfile profile;
+    std::string mode_name = request.value("mode", "car");
+    TravelMode mode = travelModeByName(mode_name);
+    if (!mode) throw std::runtime_error("unknown mode: " + mode_name);
+    std::string name = request.value("profile", "fastest");
+    if (!CostProfile::named(name, mode, profile)) throw std::runtime_error("unknown profile: " + name);
+    if (request.contains("speeds")) {
+        for (const auto& [key, value] : request["speeds"].items()) {
+            RoadClass road_class = roadClassByName(key);
+            double speed = value.get<double>();
+            if (road_class == kRoadClassCount) throw std::runtime_error("unknown road class: " + key);
+            if (speed < 0) throw std::runtime_error("negative speed for " + key);
+            profile.speed[road_class] = speed;
+        }
+    }
+    profile.u_turn = request.value("u_turn", 0.0);
+    if (profile.u_turn < 0) throw std::runtime_error("negative u_turn");
+    return profile;
+}
+
 void handlePathFinding(const httplib::Request& req, httplib::Response& res) {
     
     //cout << "waiting" << endl;
@@ -20,155 +82,633 @@ void handlePathFinding(const httplib::Request& req, httplib::Response& res) {
     double endLat = parsed_json["end"]["lat"];
     double endLng = parsed_json["end"]["lng"];
     auto mode = parsed_json["algorithm"];
+    // 默认配置直接使用图中预先写入的边权；其他配置在搜索时按边长和道路等级现算，
+    // CH 和 ALT 只按默认配置预处理，此时退回双向 A*。
+    // 有对所选出行方式生效的转向限制或要计入掉头代价时，按顶点的搜索会走出被禁止的转弯，
+    // 此时无论指定哪种算法都改为按边搜索；也可以用 "turn-aware" 显式指定按边搜索。
+    // 响应中的 algorithm 为实际运行的算法
+    const CostProfile profile = parseProfile(parsed_json);
+    const CostProfile* costs = profile == CostProfile::fastest() ? nullptr : &profile;
     auto find_start = std::chrono::high_resolution_clock::now();
 
-    // 这里调用你的寻路函数，传入经纬度作为参数
-    // std::vector<GeoPoint> path = findPath(startLat, startLng, endLat, endLng);
-    long long startNodeId = findNearestNode(startLat, startLng);
-    long long endNodeId = findNearestNode(endLat, endLng);
+    // 吸附到最近的路段上，搜索从投影点沿路段走到两端开始；没有路段索引时退回最近顶点
+    RoadPosition startPosition{}, endPosition{};
+    Endpoint source, target;
+    bool onSegments = road_segments.nearest(startLat, startLng, startPosition, costs) &&
+                      road_segments.nearest(endLat, endLng, endPosition, costs);
+    if (onSegments) {
+        source = graph.departure(startPosition, costs);
+        target = graph.arrival(endPosition, costs);
+    } else {
+        long long startNodeId = findNearestConnectedNode(startLat, startLng);
+        long long endNodeId = findNearestConnectedNode(endLat, endLng);
+        Graph::Index startIndex = graph.indexOf(startNodeId), endIndex = graph.indexOf(endNodeId);
+        if (startIndex == Graph::kInvalidIndex || endIndex == Graph::kInvalidIndex) throw std::runtime_error("map has no roads");
+        source = Endpoint::at(startIndex);
+        target = Endpoint::at(endIndex);
+        startPosition.lat = graph.latOf(startIndex);
+        startPosition.lon = graph.lonOf(startIndex);
+        endPosition.lat = graph.latOf(endIndex);
+        endPosition.lon = graph.lonOf(endIndex);
+    }
     auto find_end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double, std::milli> find_duration = find_end - find_start;
-    //cout << "Find shortest path: " << find_duration.count() << " ms" << endl;
     
-    // 查找最短路径
-    cout << startNodeId << ": lat: " << nodes[startNodeId].lat << " lon: " << nodes[startNodeId].lon << endl;
-    cout << endNodeId << ": lat: " << nodes[endNodeId].lat << " lon: " << nodes[endNodeId].lon << endl;
+    // 查找最短路径；起终点在同一路段上且可以直接沿路段到达时不需要搜索
+    const uint64_t pops_before = Graph::workspace(0).popCount() + Graph::workspace(1).popCount();
     vector<long long> shortestPath;
-    if(mode == "dijkstra") shortestPath = graph.dijkstra(startNodeId, endNodeId);
-    else if(mode == "a-star") shortestPath = graph.a_star(startNodeId, endNodeId);
-    else shortestPath = graph.bidirectional_a_star(startNodeId, endNodeId);
+    vector<uint32_t> pathEdges;
+    bool turnAware = graph.hasTurnRestrictions(profile.mode) || profile.uTurnCost() > 0;
+    Algorithm algorithm = Algorithm::Bidirectional;
+    bool direct = onSegments && graph.alongSegment(startPosition, endPosition, costs) != SearchSpace::kInfinity;
+    if (direct) {
+        // 直接沿路段行驶，路径不经过任何顶点
+    }
+    else if(turnAware || mode == "turn-aware") {
+        algorithm = Algorithm::TurnAware;
+        shortestPath = graph.turn_aware(source, target, costs, &pathEdges);
+    }
+    else if(mode == "dijkstra") {
+        algorithm = Algorithm::Dijkstra;
+        shortestPath = graph.dijkstra(source, target, costs);
+    }
+    else if(mode == "a-star") {
+        algorithm = Algorithm::AStar;
+        shortestPath = graph.a_star(source, target, costs);
+    }
+    else if(mode == "alt" && !landmarks.empty() && !costs) {
+        algorithm = Algorithm::Alt;
+        shortestPath = landmarks.query(graph, source, target);
+    }
+    else if(mode == "ch" && !hierarchy.empty() && !costs) {
+        algorithm = Algorithm::Ch;
+        shortestPath = hierarchy.query(graph, source, target);
+    }
+    else shortestPath = graph.bidirectional_a_star(source, target, costs);
     auto find_path_end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double, std::milli> find_path_duration = find_path_end - find_end;
-    //cout << "Find shortest path: " << find_duration.count() << " ms" << endl;
-    if (!shortestPath.empty()) {
-        cout << "Shortest path found: " << "\n";
-        for (long long nodeId : shortestPath) {
-            cout << on_way[nodeId].speedLimit << on_way[nodeId].name << " ";
-            cout << nodeId << ": lat: " << nodes[nodeId].lat << " lon: " << nodes[nodeId].lon << endl;
-        }
-        cout << endl;
-    } else {
-        cout << "No path found." << endl;
+    const uint64_t pops_after = Graph::workspace(0).popCount() + Graph::workspace(1).popCount();
+
+    // 搜索只经过路口，把各条边压缩掉的形状点展开回来，两端再接上从投影点到首尾顶点的部分路段；
+    // 展开时顺带按道路累计各段的长度
+    bool found = direct || !shortestPath.empty();
+    Route route;
+    if (direct) {
+        graph.appendAlong(startPosition, endPosition, route);
+    } else if (found) {
+        if (onSegments) graph.appendDeparture(startPosition, graph.indexOf(shortestPath.front()), route, costs);
+        // 按边搜索给出了实际所走的边，其余搜索只有顶点序列，相邻顶点之间取代价最小的边
+        if (algorithm == Algorithm::TurnAware) graph.appendEdges(graph.indexOf(shortestPath.front()), pathEdges, route);
+        else graph.appendPath(shortestPath, route, costs);
+        if (onSegments) graph.appendArrival(graph.indexOf(shortestPath.back()), endPosition, route, costs);
+    }
+    if (!route.legs.empty()) {
+        route.legs.front().lat = startPosition.lat;
+        route.legs.front().lon = startPosition.lon;
     }
+    metrics.record({algorithm, found, uint32_t(pops_after - pops_before),
+                    uint32_t(route.nodes.size()), route.meters,
+                    find_duration.count(), find_path_duration.count()});
+
     // 构建响应体
     json response;
-    // 将路径信息加入response
-    response["path"] = shortestPath;
+    // 将路径信息加入response；start / end 为吸附后的起终点，路径夹在两者之间
+    std::vector<long long> path;
+    path.reserve(route.nodes.size());
+    for (const Node& node : route.nodes) path.push_back(node.id);
+    response["path"] = path;
+    // 绘制用的几何：从吸附后的起点经路径上各节点到终点。geometry 为 "polyline" 时返回编码折线，
+    // 否则返回 [lat, lng] 数组；给出 zoom 时按该缩放级别一个像素的容差化简
+    if (found) {
+        std::vector<Node> shape;
+        shape.reserve(route.nodes.size() + 2);
+        shape.push_back({0, startPosition.lat, startPosition.lon});
+        shape.insert(shape.end(), route.nodes.begin(), route.nodes.end());
+        shape.push_back({0, endPosition.lat, endPosition.lon});
+        if (parsed_json.contains("zoom")) {
+            shape = simplifyPolyline(shape, toleranceForZoom(parsed_json["zoom"].get<int>(), startPosition.lat));
+        }
+        if (parsed_json.value("geometry", "coordinates") == "polyline") {
+            response["polyline"] = encodePolyline(shape);
+        } else {
+            json coordinates = json::array();
+            for (const Node& node : shape) coordinates.push_back({node.lat, node.lon});
+            response["coordinates"] = coordinates;
+        }
+    }
+    // 总路程（米）与总用时（秒），以及按道路划分的各段：道路名称、类型、驶入位置、长度和用时；
+    // 用时按所选代价配置中各道路等级的速度计算
+    if (found) {
+        double duration = 0;
+        json legs = json::array();
+        for (const RouteLeg& leg : route.legs) {
+            double seconds = profile.seconds(leg.road_class, leg.meters);
+            duration += seconds;
+            legs.push_back({{"name", way_table.name(leg.way)},
+                            {"highway", way_table.highway(leg.way)},
+                            {"location", {{"lat", leg.lat}, {"lng", leg.lon}}},
+                            {"distance", leg.meters},
+                            {"duration", seconds}});
+        }
+        response["distance"] = route.meters;
+        response["duration"] = duration;
+        response["legs"] = legs;
+    }
+    response["algorithm"] = algorithmName(algorithm);
+    response["start"] = {{"lat", startPosition.lat}, {"lng", startPosition.lon}};
+    response["end"] = {{"lat", endPosition.lat}, {"lng", endPosition.lon}};
     response["time1"] = find_duration.count();
     response["time2"] = find_path_duration.count();
 
     res.set_content(response.dump(), "application/json");
   } catch (const std::exception& e) {
     res.status = 400;
-    cout << e.what() << endl;
+    metrics.recordError();
+    writeLog(std::string(e.what()) + "\n");
     res.set_content("Bad Request", "text/plain");
   }
 }
 
-void initialize(){
-    auto load_start = std::chrono::high_resolution_clock::now();
-    xml_document doc;
-    if (!doc.load_file("map.osm")) {
-        std::cerr << "Failed to load file" << std::endl;
+// 计算一个 /matrix 请求所用的线程数（含处理请求的工作线程），0 表示使用硬件并发数。
+// 除工作线程外的 matrix_threads - 1 个线程组成常驻池，启动时创建并预分配搜索状态，由所有 /matrix 请求共用：
+// 同时到来的请求轮流使用池中的线程，不会额外建线程。池中线程与 HTTP 工作线程争用 CPU，
+// 设为 1 时不建池，矩阵只在处理请求的工作线程上计算
+unsigned matrix_threads = 0;
+std::unique_ptr<TaskPool> matrix_pool;
+
+// 单次请求允许的矩阵规模上限（源数 × 目标数）
+const size_t kMaxMatrixCells = 250000;
+
+// 输入 sources / targets 两组经纬度（targets 缺省时等于 sources），以及与 /path-finding 相同的代价配置字段
+// （mode、profile、speeds；u_turn 不适用于矩阵）；返回 durations（秒）和 distances（米）两张表，不可达为 null。
+// 默认配置使用收缩层次，其他配置对每个源做一次按该配置计费的一对多 Dijkstra
+void handleMatrix(const httplib::Request& req, httplib::Response& res) {
+  try {
+    auto parsed_json = json::parse(req.body);
+    const auto& source_points = parsed_json.at("sources");
+    const auto& target_points = parsed_json.contains("targets") ? parsed_json["targets"] : source_points;
+    if (source_points.size() * target_points.size() > kMaxMatrixCells) {
+        res.status = 413;
+        res.set_content("Matrix too large", "text/plain");
         return;
     }
-    xml_node osm = doc.document_element();
-
-    for (xml_node node : osm.children("node")) {
-        long long id = node.attribute("id").as_llong();
-        double lat = node.attribute("lat").as_double();
-        double lon = node.attribute("lon").as_double();
-        false_nodes[id] = {id, lat, lon};
-        //cout << id << ": lat: " << nodes[id].lat << " lon: " << nodes[id].lon << endl;
-    }
-
-    for (xml_node way : osm.children("way")) {
-        std::unordered_map<std::string, double> speedLimits = {
-            {"motorway", 120},
-            {"trunk", 100},
-            {"motorway_junction", 100},
-            {"primary", 60},
-            {"secondary", 40},
-            {"tertiary", 30},
-            {"unclassified", 20},
-            {"residential", 20},
-            {"service", 20}
-        };
+    const CostProfile profile = parseProfile(parsed_json);
+    const CostProfile* costs = profile == CostProfile::fastest() ? nullptr : &profile;
+    auto find_start = std::chrono::high_resolution_clock::now();
+
+    // 与 /path-finding 一样吸附到所选出行方式能通行的最近路段上，从投影点沿路段走到两端；没有路段索引时退回最近顶点
+    auto snap = [costs](const json& points, std::vector<RoadPosition>& positions, bool departing) {
+        std::vector<Endpoint> endpoints;
+        for (const auto& point : points) {
+            double lat = point.at("lat"), lng = point.at("lng");
+            RoadPosition position{};
+            if (road_segments.nearest(lat, lng, position, costs)) {
+                endpoints.push_back(departing ? graph.departure(position, costs) : graph.arrival(position, costs));
+            } else {
+                Graph::Index v = graph.indexOf(findNearestConnectedNode(lat, lng));
+                endpoints.push_back(v == Graph::kInvalidIndex ? Endpoint{} : Endpoint::at(v));
+                position.forward = position.backward = Graph::kInvalidEdge;
+            }
+            positions.push_back(position);
+        }
+        return endpoints;
+    };
+    std::vector<RoadPosition> source_positions, target_positions;
+    std::vector<Endpoint> sources = snap(source_points, source_positions, true);
+    std::vector<Endpoint> targets = snap(target_points, target_positions, false);
+    auto find_end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> find_duration = find_end - find_start;
+
+    TravelMatrix matrix = computeTravelMatrix(sources, targets, matrix_pool.get(), costs);
+    // 起终点在同一路段上时直接沿路段行驶可能比绕到端点更近
+    for (size_t i = 0; i < matrix.rows; ++i) {
+        const RoadPosition& from = source_positions[i];
+        if (from.forward == Graph::kInvalidEdge && from.backward == Graph::kInvalidEdge) continue;
+        for (size_t j = 0; j < matrix.cols; ++j) {
+            const RoadPosition& to = target_positions[j];
+            double along = graph.alongSegment(from, to, costs);
+            if (along >= matrix.weights[i * matrix.cols + j]) continue;
+            uint32_t edge = to.fraction >= from.fraction ? from.forward : from.backward;
+            double part = std::fabs(to.fraction - from.fraction);
+            matrix.weights[i * matrix.cols + j] = along;
+            matrix.lengths[i * matrix.cols + j] = part * graph.edgeLength(edge);
+            matrix.seconds[i * matrix.cols + j] = part * graph.edgeSeconds(edge, costs);
+        }
+    }
+    auto matrix_end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> matrix_duration = matrix_end - find_end;
+    metrics.record({Algorithm::Matrix, true, 0, uint32_t(matrix.rows * matrix.cols), 0,
+                    find_duration.count(), matrix_duration.count()});
+
+    json durations = json::array(), distances = json::array();
+    for (size_t i = 0; i < matrix.rows; ++i) {
+        json duration_row = json::array(), distance_row = json::array();
+        for (size_t j = 0; j < matrix.cols; ++j) {
+            double weight = matrix.weights[i * matrix.cols + j];
+            if (weight == SearchSpace::kInfinity) {
+                duration_row.push_back(nullptr);
+                distance_row.push_back(nullptr);
+            } else {
+                duration_row.push_back(matrix.seconds[i * matrix.cols + j]);
+                distance_row.push_back(matrix.lengths[i * matrix.cols + j]);
+            }
+        }
+        durations.push_back(std::move(duration_row));
+        distances.push_back(std::move(distance_row));
+    }
+
+    json response;
+    response["durations"] = std::move(durations);
+    response["distances"] = std::move(distances);
+    response["time1"] = find_duration.count();
+    response["time2"] = matrix_duration.count();
+    res.set_content(response.dump(), "application/json");
+  } catch (const std::exception& e) {
+    res.status = 400;
+    metrics.recordError();
+    writeLog(std::string(e.what()) + "\n");
+    res.set_content("Bad Request", "text/plain");
+  }
+}
+
+// 单次 /nearest 请求最多返回的节点数
+const size_t kMaxNearest = 256;
+
+// 输入 lat / lng，以及 k（默认 10）和可选的 radius（米）；
+// 返回按距离升序排列的节点 {id, lat, lng, meters}，给定 radius 时只返回范围内的最近 k 个
+void handleNearest(const httplib::Request& req, httplib::Response& res) {
+  try {
+    auto parsed_json = json::parse(req.body);
+    double lat = parsed_json.at("lat"), lng = parsed_json.at("lng");
+    size_t k = std::min<size_t>(parsed_json.value("k", 10), kMaxNearest);
+    auto query_start = std::chrono::high_resolution_clock::now();
+
+    Neighbor neighbors[kMaxNearest];
+    size_t count = parsed_json.contains("radius")
+        ? spatial_index->withinRadius(lat, lng, parsed_json["radius"].get<double>(), neighbors, k)
+        : spatial_index->nearest(lat, lng, k, neighbors);
+    std::chrono::duration<double, std::milli> query_duration = std::chrono::high_resolution_clock::now() - query_start;
+
+    json result = json::array();
+    for (size_t i = 0; i < count; ++i) {
+        result.push_back({{"id", neighbors[i].id}, {"lat", neighbors[i].lat}, {"lng", neighbors[i].lon},
+                          {"meters", neighbors[i].meters}});
+    }
+    json response;
+    response["nodes"] = std::move(result);
+    response["time"] = query_duration.count();
+    res.set_content(response.dump(), "application/json");
+  } catch (const std::exception& e) {
+    res.status = 400;
+    metrics.recordError();
+    writeLog(std::string(e.what()) + "\n");
+    res.set_content("Bad Request", "text/plain");
+  }
+}
+
+// 流式加载：节点、道路和关系在读取时直接交给建图逻辑，不再保留整棵 DOM。
+// OSM 文件里节点在道路之前，读到节点时还不知道它是否在道路上，先把坐标存进紧凑的临时数组，
+// 建图后只有道路上的节点留在图里；转向限制关系在建图后才能落到具体的边上，先记下成员
+class GraphLoader : public OsmHandler {
+public:
+    // 道路属性在读到时就写入 way_table，这里只留下建边需要的节点序列
+    struct PendingWay {
+        uint32_t way;                // way_table 中的下标
+        size_t nodes_begin, nodes_end;  // 在 way_nodes 中的范围
+    };
+
+    // 经由节点的转向限制：从道路 from 经节点 via 驶入道路 to（only 为真时表示只能这样走），
+    // u_turn 表示限制的是掉头（no_u_turn / only_u_turn）
+    struct PendingRestriction {
+        long long from, via, to;
+        bool only, u_turn;
+        uint8_t modes;
+    };
+
+    std::vector<Node> coordinates;
+    std::vector<PendingWay> ways;
+    std::vector<long long> way_nodes;
+    std::vector<PendingRestriction> restrictions;
+    size_t skipped_restrictions = 0;   // 经由道路等暂不支持的限制
+
+    void node(long long id, double lat, double lon) override {
+        coordinates.push_back({id, lat, lon});
+    }
+
+    void way(const OsmWay& way) override {
         bool is_way = false;
-        long long id = way.attribute("id").as_llong();
-        Way w{ id };
-        for (xml_node nd : way.children("nd")) {
-            long long id = nd.attribute("id").as_llong();
-            double lat = nd.attribute("lat").as_double();
-            double lon = nd.attribute("lon").as_double();
-            nodes[id] = {id, lat, lon};
-            w.node_ids.push_back(nd.attribute("ref").as_llong());
-        }
-        w.speedLimit = 30.0;
-        w.name = "unknown";
-        w.oneway = false;
-        for (auto tagNode : way.children("tag")) {
-            auto kAttr = tagNode.attribute("k");
-            auto vAttr = tagNode.attribute("v");
-
-            if (kAttr && vAttr) {
-                std::string key = kAttr.value();
-                std::string value = vAttr.value();
-                if (key == "highway") {
-                    is_way = true;
-                    w.highwayType = value;
-                } 
-                else if (key == "name:en") {
-                    w.name = value;
-                }
-                else if (key == "oneway") {
-                    w.oneway = value == "yes" ? true : false;
-                }
+        std::string highwayType, name = "unknown";
+        double speedLimit = 30.0;
+        for (const auto& [key, value] : way.tags) {
+            if (key == "highway") {
+                is_way = true;
+                highwayType = value;
+            }
+            else if (key == "name:en") {
+                name = value;
             }
-            
-        }
-        if (!w.highwayType.empty()) {
-            w.speedLimit = speedLimits.count(w.highwayType) ? speedLimits[w.highwayType] : 30.0;
-        }
-        if(is_way) {
-            for (xml_node nd : way.children("nd")) {
-                long long id = nd.attribute("ref").as_llong();
-                nodes[id] = false_nodes[id];
-                w.node_ids.push_back(id);
-                // 将节点插入K-d树
-                KDTree::Point point{nodes[id].lat, nodes[id].lon, id};
-                kdtree.insert(point);
+        }
+        // 限速取默认代价配置中该道路等级的速度
+        if (!highwayType.empty()) speedLimit = CostProfile::fastest().speed[roadClassOf(highwayType)];
+        // 各出行方式的通行权和单行由 access 类标签决定，任何方式都不能通行的道路不进入路网
+        WayAccess access = wayAccessOf(way.tags);
+        if(is_way && way.node_refs.size() >= 2 && (access.forward | access.backward)) {
+            uint32_t index = way_table.add(way.id, access, speedLimit, highwayType, name);
+            ways.push_back({index, way_nodes.size(), way_nodes.size() + way.node_refs.size()});
+            way_nodes.insert(way_nodes.end(), way.node_refs.begin(), way.node_refs.end());
+        }
+    }
+
+    // type=restriction 关系：restriction 标签对汽车和自行车生效，restriction:motorcar / restriction:bicycle
+    // 只对一种方式生效，except 中列出的方式不受限制。值以 no_ 开头为禁止，以 only_ 开头为只能
+    void relation(const OsmRelation& relation) override {
+        std::string type, value, except;
+        uint8_t modes = 0;
+        for (const auto& [key, tag] : relation.tags) {
+            if (key == "type") type = tag;
+            else if (key == "except") except = tag;
+            else if (key == "restriction") value = tag, modes = kCar | kBike;
+            else if (key == "restriction:motorcar" || key == "restriction:motor_vehicle") value = tag, modes = kCar;
+            else if (key == "restriction:bicycle") value = tag, modes = kBike;
+        }
+        if (type != "restriction" || value.empty()) return;
+        std::stringstream excepted(except);
+        for (std::string item; std::getline(excepted, item, ';');) {
+            if (item == "motorcar" || item == "motor_vehicle") modes &= uint8_t(~kCar);
+            else if (item == "bicycle") modes &= uint8_t(~kBike);
+        }
+        bool only = value.rfind("only_", 0) == 0;
+        if (!modes || (!only && value.rfind("no_", 0) != 0)) return;
+
+        PendingRestriction restriction{0, 0, 0, only, value.find("_u_turn") != std::string::npos, modes};
+        size_t from_count = 0, via_count = 0, to_count = 0;
+        for (const OsmMember& member : relation.members) {
+            if (member.role == "from" && member.type == OsmMember::kWay) restriction.from = member.ref, ++from_count;
+            else if (member.role == "to" && member.type == OsmMember::kWay) restriction.to = member.ref, ++to_count;
+            else if (member.role == "via") restriction.via = member.ref, via_count += member.type == OsmMember::kNode ? 1 : 2;
+        }
+        if (from_count == 1 && via_count == 1 && to_count == 1) restrictions.push_back(restriction);
+        else ++skipped_restrictions;
+    }
+};
+
+// 把经由节点的转向限制落到图的边上：经由节点是顶点，from 道路上驶入它的边转到 to 道路上驶出它的边即为限制所指的转向，
+// no_ 禁止这些转向，only_ 禁止其余所有转向（to 道路不在路网中时即禁止从 from 道路出发的所有转向）。
+// from 与 to 是同一条道路时用是否沿原路段返回区分掉头和直行
+void applyTurnRestrictions(const std::vector<GraphLoader::PendingRestriction>& pending) {
+    std::unordered_map<long long, uint32_t> way_index;
+    way_index.reserve(way_table.size());
+    for (uint32_t w = 0; w < way_table.size(); ++w) way_index.emplace(way_table[w].id, w);
+
+    std::vector<TurnRestriction> restrictions;
+    size_t applied = 0;
+    for (const auto& r : pending) {
+        Graph::Index via = graph.indexOf(r.via);
+        auto from = way_index.find(r.from), to = way_index.find(r.to);
+        if (via == Graph::kInvalidIndex || from == way_index.end() || (to == way_index.end() && !r.only)) continue;
+        uint32_t to_way = to == way_index.end() ? uint32_t(way_table.size()) : to->second;
+        size_t before = restrictions.size();
+        for (uint32_t i = graph.inEdgeBegin(via); i < graph.inEdgeEnd(via); ++i) {
+            uint32_t in = graph.inEdge(i);
+            if (graph.edgeWay(in) != from->second) continue;
+            for (uint32_t out = graph.edgeBegin(via); out < graph.edgeEnd(via); ++out) {
+                bool turning_back = graph.edgeChain(out) == graph.edgeChain(in);
+                bool matches = graph.edgeWay(out) == to_way && (r.from != r.to || turning_back == r.u_turn);
+                if (matches != r.only) restrictions.push_back({in, out, r.modes});
             }
-            ways.push_back(w);
         }
+        applied += restrictions.size() > before;
     }
+    cout << "Turn restrictions: " << applied << " of " << pending.size() << " applied" << endl;
+    graph.restrictTurns(std::move(restrictions));
+}
 
-    // 解析OSM XML文件并填充nodes和ways...
-    // （这部分代码与之前的解析部分相同）
+bool initialize(const std::string& path = "map.osm"){
+    auto load_start = std::chrono::high_resolution_clock::now();
+    GraphLoader loader;
+    if (!readOsm(path, loader)) {
+        std::cerr << "Failed to load file" << std::endl;
+        return false;
+    }
+    way_table.freeze();
 
-// 假设你已经有了nodes和ways的数据
-    for (const auto& way : ways) {
-        for (size_t i = 0; i < way.node_ids.size() - 1; ++i) {
-            long long from = way.node_ids[i];
-            long long to = way.node_ids[i + 1];
-            on_way[from] = way;
-            on_way[to] = way;
-            // 添加边到图中
-            double weight = calculateDistance(nodes[from], nodes[to]) / way.speedLimit;
-            graph.addEdge(from, to, weight);
-            if(!way.oneway) graph.addEdge(to, from, weight);
+    // 坐标按 ID 排序后二分查找；OSM 文件通常已按 ID 排好序。文件里缺少坐标的节点连同它所在的边一起跳过
+    std::vector<Node>& coordinates = loader.coordinates;
+    auto byId = [](const Node& a, const Node& b) { return a.id < b.id; };
+    if (!std::is_sorted(coordinates.begin(), coordinates.end(), byId)) {
+        std::sort(coordinates.begin(), coordinates.end(), byId);
+    }
+    auto find = [&coordinates](long long id) -> const Node* {
+        auto it = std::lower_bound(coordinates.begin(), coordinates.end(), id,
+                                   [](const Node& node, long long key) { return node.id < key; });
+        return it != coordinates.end() && it->id == id ? &*it : nullptr;
+    };
+    // 道路上第 i 个节点与下一个节点之间的路段长度写在 lengths[i]，端点缺少坐标时为负；
+    // 各条道路互不重叠，可以并行计算，之后再按文件顺序加边
+    std::vector<double> lengths(loader.way_nodes.size());
+    parallelFor(loader.ways.size(), 0, [&](size_t w) {
+        const GraphLoader::PendingWay& pending = loader.ways[w];
+        for (size_t i = pending.nodes_begin; i + 1 < pending.nodes_end; ++i) {
+            const Node* from_node = find(loader.way_nodes[i]);
+            const Node* to_node = find(loader.way_nodes[i + 1]);
+            lengths[i] = from_node && to_node ? calculateDistance(*from_node, *to_node) : -1;
+        }
+    });
+    // 在道路序列中出现不止一次的节点是路口（或道路自身闭合处），必须保留为顶点
+    std::vector<long long> shared = loader.way_nodes;
+    std::sort(shared.begin(), shared.end());
+    size_t shared_count = 0;
+    for (size_t i = 0; i + 1 < shared.size(); ++i) {
+        if (shared[i] == shared[i + 1] && (shared_count == 0 || shared[shared_count - 1] != shared[i])) {
+            shared[shared_count++] = shared[i];
         }
     }
+    shared.resize(shared_count);
+    // 转向限制的经由节点也要保留为顶点，限制才能落在边与边之间
+    for (const auto& restriction : loader.restrictions) shared.push_back(restriction.via);
+    std::sort(shared.begin(), shared.end());
+    shared.erase(std::unique(shared.begin(), shared.end()), shared.end());
+    auto isShared = [&shared](long long id) { return std::binary_search(shared.begin(), shared.end(), id); };
+
+    // 每条道路在路口、端点和缺少坐标的节点处切开，中间度为 2 的节点作为形状点压缩进一条路段
+    std::vector<ShapePoint> shape;
+    for (const auto& pending : loader.ways) {
+        const WayTable::Record& way = way_table[pending.way];
+        const RoadClass road_class = roadClassOf(way_table.highway(pending.way));
+        long long from = 0;
+        double length = 0;
+        bool open = false;
+        for (size_t i = pending.nodes_begin; i + 1 < pending.nodes_end; ++i) {
+            if (lengths[i] < 0) {
+                open = false;
+                continue;
+            }
+            if (!open) {
+                from = loader.way_nodes[i];
+                length = 0;
+                shape.clear();
+                open = true;
+            }
+            length += lengths[i];
+            long long to = loader.way_nodes[i + 1];
+            bool last = i + 2 == pending.nodes_end || lengths[i + 1] < 0;
+            if (!last && !isShared(to)) {
+                const Node* node = find(to);
+                shape.push_back({to, node->lat, node->lon, length});
+                continue;
+            }
+            // 添加路段到图中，每条边记下所属道路
+            graph.addChain(from, to, length / way.speed_limit, length, pending.way, road_class, shape,
+                           way.forward_modes, way.backward_modes);
+            from = to;
+            length = 0;
+            shape.clear();
+        }
+    }
+    // 图按下标保存道路节点的坐标，临时的全量坐标表和节点序列不再需要
+    graph.freeze(coordinates);
+    applyTurnRestrictions(loader.restrictions);
+    if (loader.skipped_restrictions) cout << "Skipped " << loader.skipped_restrictions << " restrictions via ways" << endl;
+    coordinates = std::vector<Node>();
+    loader.ways = std::vector<GraphLoader::PendingWay>();
+    loader.way_nodes = std::vector<long long>();
+
+    // 一次性构建两种点索引，都写入快照，启动时再选用其一
+    kdtree.build(graph);
+    grid_index.build(graph);
+    road_segments.build(graph);
 
     auto load_end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double, std::milli> load_duration = load_end - load_start;
     cout << "Loading xml: " << load_duration.count() << " ms" << endl;
+
+    // 图加载后不再变化，预先构建收缩层次供 "ch" 查询使用
+    auto ch_start = std::chrono::high_resolution_clock::now();
+    hierarchy.build(graph);
+    std::chrono::duration<double, std::milli> ch_duration = std::chrono::high_resolution_clock::now() - ch_start;
+    cout << "Building contraction hierarchy: " << ch_duration.count() << " ms" << endl;
+
+    auto alt_start = std::chrono::high_resolution_clock::now();
+    landmarks.build(graph);
+    std::chrono::duration<double, std::milli> alt_duration = std::chrono::high_resolution_clock::now() - alt_start;
+    cout << "Building landmarks: " << alt_duration.count() << " ms" << endl;
+    return true;
 }
 
-int main() {
-    initialize();
+// 从 initialize() 生成的快照启动，跳过 XML 解析和边权计算
+bool loadSnapshot(const std::string& path = "map.graph") {
+    auto load_start = std::chrono::high_resolution_clock::now();
+    if (!loadGraphSnapshot(path)) return false;
+    auto load_end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> load_duration = load_end - load_start;
+    cout << "Loading snapshot: " << load_duration.count() << " ms" << endl;
+    return true;
+}
+
+// osm_pugixml --bench-spatial [N]：在路网包围盒内随机取 N 个点，
+// 比较两种点索引的构建时间、最近点 / 10 近邻 / 200 米半径查询的耗时，以及最近点结果是否一致
+void benchmarkSpatialIndexes(size_t queries) {
+    double min_lat = 90, max_lat = -90, min_lon = 180, max_lon = -180;
+    for (Graph::Index v = 0; v < graph.vertexCount(); ++v) {
+        min_lat = std::min(min_lat, graph.latOf(v));
+        max_lat = std::max(max_lat, graph.latOf(v));
+        min_lon = std::min(min_lon, graph.lonOf(v));
+        max_lon = std::max(max_lon, graph.lonOf(v));
+    }
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> random_lat(min_lat, max_lat), random_lon(min_lon, max_lon);
+    std::vector<std::pair<double, double>> targets(queries);
+    for (auto& [lat, lon] : targets) {
+        lat = random_lat(random);
+        lon = random_lon(random);
+    }
+
+    using Clock = std::chrono::high_resolution_clock;
+    auto micros = [](Clock::time_point start, size_t count) {
+        return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / std::max<size_t>(count, 1);
+    };
+    std::vector<long long> answers[2];
+    SpatialIndex* indexes[2] = {&kdtree, &grid_index};
+    for (int i = 0; i < 2; ++i) {
+        SpatialIndex& index = *indexes[i];
+        auto build_start = Clock::now();
+        index.build(graph);
+        double build_ms = micros(build_start, 1) / 1000;
+
+        Neighbor neighbors[kMaxNearest];
+        size_t found = 0;
+        auto start = Clock::now();
+        for (auto [lat, lon] : targets) answers[i].push_back(index.findNearestNode(lat, lon));
+        double nearest_us = micros(start, queries);
+        start = Clock::now();
+        for (auto [lat, lon] : targets) found += index.nearest(lat, lon, 10, neighbors);
+        double knn_us = micros(start, queries);
+        start = Clock::now();
+        for (auto [lat, lon] : targets) found += index.withinRadius(lat, lon, 200, neighbors, kMaxNearest);
+        double radius_us = micros(start, queries);
+
+        cout << index.name() << ": build " << build_ms << " ms, nearest " << nearest_us << " us, knn(10) " << knn_us
+             << " us, radius(200m) " << radius_us << " us (" << found << " results)" << endl;
+    }
+    size_t agree = 0;
+    for (size_t q = 0; q < queries; ++q) agree += answers[0][q] == answers[1][q];
+    cout << "nearest node agreement: " << agree << " / " << queries << endl;
+}
+
+int main(int argc, char* argv[]) {
+    // osm_pugixml --compile [map.osm | map.osm.pbf] [map.graph]：离线解析并写出快照后退出
+    if (argc >= 2 && std::string(argv[1]) == "--compile") {
+        std::string osm_path = argc >= 3 ? argv[2] : "map.osm";
+        std::string graph_path = argc >= 4 ? argv[3] : "map.graph";
+        if (!initialize(osm_path)) return 1;
+        if (!saveGraphSnapshot(graph_path)) {
+            std::cerr << "Failed to write " << graph_path << std::endl;
+            return 1;
+        }
+        cout << "Snapshot written to " << graph_path << endl;
+        return 0;
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-spatial") {
+        if (!loadSnapshot() && !initialize()) return 1;
+        benchmarkSpatialIndexes(argc >= 3 ? std::stoul(argv[2]) : 100000);
+        return 0;
+    }
+
+    // osm_pugixml [--threads N] [--matrix-threads N] [--spatial-index kdtree|grid] [--log-requests]：
+    // 工作线程数默认等于硬件并发数，点索引默认使用K-d树
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    bool log_requests = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--log-requests") log_requests = true;
+        else if (option == "--threads" && i + 1 < argc) threads = std::max(1, std::stoi(argv[++i]));
+        else if (option == "--matrix-threads" && i + 1 < argc) matrix_threads = unsigned(std::max(0, std::stoi(argv[++i])));
+        else if (option == "--spatial-index" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (name == "grid") spatial_index = &grid_index;
+            else if (name != "kdtree") {
+                std::cerr << "Unknown spatial index " << name << " (expected kdtree or grid)" << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    // 有快照时直接映射快照，否则回退到解析 map.osm
+    if (!loadSnapshot() && !initialize()) return 1;
+    if (matrix_threads == 0) matrix_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (matrix_threads > 1) {
+        matrix_pool = std::make_unique<TaskPool>(matrix_threads - 1, [] { graph.reserveWorkspaces(); });
+    }
     httplib::Server svr;
+    svr.new_task_queue = [threads] { return new WorkerPool(threads); };
     svr.Post("/path-finding", handlePathFinding);
+    svr.Post("/matrix", handleMatrix);
+    svr.Post("/nearest", handleNearest);
+    svr.Get("/metrics", [](const httplib::Request&, httplib::Response& res) {
+        res.set_content(metrics.render(), "text/plain; version=0.0.4");
+    });
+    metrics.start(log_requests);
+    cout << "Serving on localhost:8080 with " << threads << " worker threads, " << spatial_index->name() << " spatial index" << endl;
     svr.listen("localhost", 8080);
     return 0;
-}
\ No newline at end of file
+}